@@ -26,6 +26,13 @@
 #include <QRegularExpression>
 #include <QResource>
 #include <QTimer>
+#include <QThreadPool>
+#include <QMutex>
+#include <QSet>
+#include <QPointer>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
 #include <algorithm>
 #include "Plugvex.H"
 #include "Settings.H"
@@ -43,10 +50,10 @@ private:
     QMap<QString, QColor> m_colors;
 };
 
-class LookAndFeelCorePlugin : public QObject, public CorePlugin {
+class LookAndFeelCorePlugin : public QObject, public CorePlugin, public DeferredPlugin {
     Q_OBJECT
-    Q_PLUGIN_METADATA(IID "vex.core/4.0")
-    Q_INTERFACES(CorePlugin)
+    Q_PLUGIN_METADATA(IID "vex.core/4.0" FILE "LookAndFeelCore.json")
+    Q_INTERFACES(CorePlugin DeferredPlugin)
 
 public:
     PluginMetadata meta() const override {
@@ -90,6 +97,7 @@ public:
 
         connect(themeWatcher, &QFileSystemWatcher::directoryChanged, this, [this](const QString &path) {
             Q_UNUSED(path)
+            Settings::instance().clearIconCache();
             m_mainWindow->statusBar()->showMessage("Theme directory changed, reloading...", 2000);
             rebuildThemesMenu();
             rebuildIconMenu();
@@ -97,6 +105,11 @@ public:
         connect(themeWatcher, &QFileSystemWatcher::fileChanged,
                 this, &LookAndFeelCorePlugin::onThemeFileChanged);
 
+        themeReloadTimer = new QTimer(this);
+        themeReloadTimer->setSingleShot(true);
+        themeReloadTimer->setInterval(THEME_RELOAD_DELAY_MS);
+        connect(themeReloadTimer, &QTimer::timeout, this, &LookAndFeelCorePlugin::reloadThemeInBackground);
+
         createViewMenuIntegration();
         loadPreferences();
 
@@ -105,6 +118,11 @@ public:
         return true;
     }
 
+    void idle() override {
+        rebuildThemesMenu();
+        rebuildIconMenu();
+    }
+
 private slots:
     void onQtStyleSelected(QAction *action) {
         QString styleName = action->data().toString();
@@ -130,6 +148,8 @@ private slots:
 
         if (themePath.isEmpty()) {
             qApp->setStyleSheet("");
+            appliedThemeHash.clear();
+            appliedRules.clear();
             currentThemePath = "";
             Settings::instance().remove("currentThemePath");
             m_mainWindow->statusBar()->showMessage("Theme: None", 2000);
@@ -176,22 +196,41 @@ private slots:
     }
 
     void onThemeFileChanged(const QString &path) {
-        m_mainWindow->statusBar()->showMessage(
-            QString("Theme file changed: %1").arg(QFileInfo(path).fileName()), 2000);
-
-        if (!themeWatcher->files().contains(path))
+        if (!themeWatcher->files().contains(path) && QFile::exists(path))
             themeWatcher->addPath(path);
 
         if (path.startsWith(":/") || path.startsWith("qrc:"))
             return;
 
         if (path == currentThemePath) {
-            applyTheme(path, false);
-            m_mainWindow->statusBar()->showMessage("Theme hot-reloaded: " + QFileInfo(path).baseName(), 2000);
+            themeReloadRetries = 0;
+            themeReloadTimer->start();
         }
     }
 
 private:
+    struct IconThemeInfo {
+        QString name;
+        QString displayName;
+        bool user = false;
+    };
+
+    struct IconDirCache {
+        qint64 mtime = 0;
+        QList<IconThemeInfo> themes;
+    };
+
+    struct ParsedTheme {
+        bool valid = false;
+        QByteArray hash;
+        QString qss;
+        QMap<QString, QString> vexProps;
+        QStringList rules;
+    };
+
+    static constexpr int THEME_RELOAD_DELAY_MS = 150;
+    static constexpr int THEME_RELOAD_RETRIES = 3;
+
     QMainWindow        *m_mainWindow{nullptr};
     QMenu              *viewMenu{nullptr};
     QMenu              *qtStyleMenu{nullptr};
@@ -204,6 +243,16 @@ private:
     QString             iconsPath;
     QString             currentThemePath;
     QString             currentIconTheme;
+    QList<IconThemeInfo> iconThemes;
+    bool                iconThemesReady{false};
+    bool                iconMenuStale{true};
+    quint64             iconDiscoveryGeneration{0};
+    QTimer             *themeReloadTimer{nullptr};
+    quint64             themeReloadGeneration{0};
+    int                 themeReloadRetries{0};
+    QByteArray          appliedThemeHash;
+    QStringList         appliedRules;
+    QMap<QString, QString> appliedVexProps;
 
     void createViewMenuIntegration() {
         QList<QAction*> acts = m_mainWindow->menuBar()->actions(); for (QAction *action : acts) {
@@ -230,10 +279,12 @@ private:
         noneThemeAction->setData("");
 
         themesMenu->addSeparator();
-        rebuildThemesMenu();
 
         iconMenu = viewMenu->addMenu("&Icon Theme");
-        rebuildIconMenu();
+        connect(iconMenu, &QMenu::aboutToShow, this, [this]() {
+            if (iconDiscoveryGeneration == 0) rebuildIconMenu();
+            if (iconMenuStale) populateIconMenu();
+        });
     }
 
     void populateQtStyleMenu() {
@@ -331,9 +382,32 @@ private:
     }
 
     void rebuildIconMenu() {
+        const quint64 generation = ++iconDiscoveryGeneration;
+        const QString userDir = iconsPath;
+        QPointer<LookAndFeelCorePlugin> self(this);
+        QThreadPool::globalInstance()->start([self, generation, userDir]() {
+            QList<IconThemeInfo> themes = discoverIconThemes(userDir);
+            QMetaObject::invokeMethod(qApp, [self, generation, themes]() {
+                if (!self || generation != self->iconDiscoveryGeneration) return;
+                self->iconThemes = themes;
+                self->iconThemesReady = true;
+                self->iconMenuStale = true;
+                if (self->iconMenu->isVisible()) self->populateIconMenu();
+            }, Qt::QueuedConnection);
+        });
+    }
+
+    void populateIconMenu() {
+        iconMenuStale = false;
         iconMenu->clear();
 
-        QActionGroup *iconGroup = new QActionGroup(this);
+        if (!iconThemesReady) {
+            iconMenuStale = true;
+            iconMenu->addAction("Searching for icon themes...")->setEnabled(false);
+            return;
+        }
+
+        QActionGroup *iconGroup = new QActionGroup(iconMenu);
         iconGroup->setExclusive(true);
 
         QString savedIconTheme = Settings::instance().get<QString>("currentIconTheme");
@@ -345,75 +419,132 @@ private:
 
         iconMenu->addSeparator();
 
-        QDir iconDir(iconsPath);
-        QStringList userIconThemes = iconDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
-        std::sort(userIconThemes.begin(), userIconThemes.end(),
-                  [](const QString &a, const QString &b) {
-                      return a.compare(b, Qt::CaseInsensitive) < 0;
-                  });
-
         bool found = false;
+        bool userSection = false;
+        for (const IconThemeInfo &theme : std::as_const(iconThemes)) {
+            if (!theme.user && userSection) {
+                iconMenu->addSeparator();
+                userSection = false;
+            }
+            userSection = theme.user;
 
-        if (!userIconThemes.isEmpty()) {
-            for (const QString &themeName : std::as_const(userIconThemes)) {
-                QAction *action = iconMenu->addAction(themeName);
-                action->setCheckable(true);
-                action->setData(themeName);
-                iconGroup->addAction(action);
+            QAction *action = iconMenu->addAction(theme.user ? theme.displayName : theme.displayName + "    xdg");
+            action->setCheckable(true);
+            action->setData(theme.name);
+            iconGroup->addAction(action);
 
-                if (!savedIconTheme.isEmpty() && themeName == savedIconTheme) {
-                    action->setChecked(true);
-                    found = true;
-                }
+            if (!savedIconTheme.isEmpty() && theme.name == savedIconTheme) {
+                action->setChecked(true);
+                found = true;
             }
-            iconMenu->addSeparator();
         }
 
+        if (!found)
+            noneAction->setChecked(true);
+
+        connect(iconGroup, &QActionGroup::triggered,
+                this, &LookAndFeelCorePlugin::onIconThemeSelected);
+    }
+
+    // Runs on a worker thread. Each icon root is listed and its themes'
+    // index.theme files parsed only when the root directory's mtime changed.
+    static QList<IconThemeInfo> discoverIconThemes(const QString &userDir) {
+        QList<IconThemeInfo> themes = scanIconDir(userDir, true);
+        QSet<QString> seen;
+        for (const IconThemeInfo &theme : std::as_const(themes))
+            seen.insert(theme.name);
+
 #if !defined(Q_OS_WIN) && !defined(Q_OS_MAC)
-        QStringList xdgIconPaths = {
+        const QStringList xdgIconPaths = {
             "/usr/share/icons",
             QDir::homePath() + "/.local/share/icons",
             QDir::homePath() + "/.icons"
         };
 
-        QSet<QString> systemThemes;
-        for (const QString &xdgPath : std::as_const(xdgIconPaths)) {
-            QDir xdgDir(xdgPath);
-            if (xdgDir.exists()) {
-                for (const QString &theme : xdgDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
-                    if (!userIconThemes.contains(theme))
-                        systemThemes.insert(theme);
+        QList<IconThemeInfo> xdgThemes;
+        for (const QString &xdgPath : xdgIconPaths) {
+            const QList<IconThemeInfo> found = scanIconDir(xdgPath, false);
+            for (const IconThemeInfo &theme : found) {
+                if (!seen.contains(theme.name)) {
+                    seen.insert(theme.name);
+                    xdgThemes.append(theme);
+                }
             }
         }
-
-        QStringList xdgThemes = systemThemes.values();
-        std::sort(xdgThemes.begin(), xdgThemes.end(), [](const QString &a, const QString &b) {
-            return a.compare(b, Qt::CaseInsensitive) < 0;
+        std::sort(xdgThemes.begin(), xdgThemes.end(), [](const IconThemeInfo &a, const IconThemeInfo &b) {
+            return a.displayName.compare(b.displayName, Qt::CaseInsensitive) < 0;
         });
+        themes.append(xdgThemes);
+#endif
+        return themes;
+    }
 
-        for (const QString &themeName : std::as_const(xdgThemes)) {
-            QAction *action = iconMenu->addAction(themeName + "    xdg");
-            action->setCheckable(true);
-            action->setData(themeName);
-            iconGroup->addAction(action);
+    static QList<IconThemeInfo> scanIconDir(const QString &path, bool user) {
+        static QMutex cacheMutex;
+        static QHash<QString, IconDirCache> cache;
+
+        QFileInfo dirInfo(path);
+        if (!dirInfo.isDir()) return {};
+        const qint64 mtime = dirInfo.lastModified().toMSecsSinceEpoch();
+        {
+            QMutexLocker lock(&cacheMutex);
+            auto it = cache.constFind(path);
+            if (it != cache.constEnd() && it->mtime == mtime) return it->themes;
+        }
 
-            if (!savedIconTheme.isEmpty() && themeName == savedIconTheme) {
-                action->setChecked(true);
-                found = true;
-            }
+        QList<IconThemeInfo> themes;
+        const QStringList entries = QDir(path).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+        for (const QString &name : entries) {
+            IconThemeInfo theme;
+            theme.name = name;
+            theme.displayName = name;
+            theme.user = user;
+            if (readIconThemeIndex(path + "/" + name, theme))
+                themes.append(theme);
         }
-#endif
+        std::sort(themes.begin(), themes.end(), [](const IconThemeInfo &a, const IconThemeInfo &b) {
+            return a.displayName.compare(b.displayName, Qt::CaseInsensitive) < 0;
+        });
 
-        if (!found)
-            noneAction->setChecked(true);
+        QMutexLocker lock(&cacheMutex);
+        cache.insert(path, {mtime, themes});
+        return themes;
+    }
 
-        if (iconMenu->actions().isEmpty()) {
-            QAction *noIcons = iconMenu->addAction("No icon themes available");
-            noIcons->setEnabled(false);
+    // Fills displayName from index.theme. Returns false for hidden themes and
+    // cursor-only themes, which provide no icon directories.
+    static bool readIconThemeIndex(const QString &themeDir, IconThemeInfo &theme) {
+        QFile file(themeDir + "/index.theme");
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            QStringList subdirs = QDir(themeDir).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+            return !(subdirs.size() == 1 && subdirs.first() == "cursors");
         }
 
-        connect(iconGroup, &QActionGroup::triggered,
-                this, &LookAndFeelCorePlugin::onIconThemeSelected);
+        bool inSection = false;
+        bool hasDirectories = false;
+        QTextStream in(&file);
+        while (!in.atEnd()) {
+            const QString line = in.readLine().trimmed();
+            if (line.startsWith('[')) {
+                if (inSection) break;
+                inSection = line == "[Icon Theme]";
+                continue;
+            }
+            if (!inSection) continue;
+
+            const qsizetype eq = line.indexOf('=');
+            if (eq <= 0) continue;
+            const QString key = line.left(eq).trimmed();
+            const QString value = line.mid(eq + 1).trimmed();
+            if (key == "Name" && !value.isEmpty()) {
+                theme.displayName = value;
+            } else if (key == "Directories" || key == "ScaledDirectories") {
+                hasDirectories = hasDirectories || !value.isEmpty();
+            } else if (key == "Hidden" && value.compare("true", Qt::CaseInsensitive) == 0) {
+                return false;
+            }
+        }
+        return hasDirectories || theme.user;
     }
 
     void refreshAllIcons() {
@@ -455,18 +586,7 @@ private:
             templateFile.close();
         }
 
-        QString fileReqPath = Settings::basePath() + "/.temp/"  + QString::number(QCoreApplication::applicationPid()) + ".Req";
-        QDir().mkpath(Settings::basePath() + "/.temp");
-
-        QFile pathFile(fileReqPath);
-        if (pathFile.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Append)) {
-            QTextStream out(&pathFile);
-            out.setEncoding(QStringConverter::Utf8);
-            out << themePath << "\n";
-            pathFile.close();
-        }
-
-        QMetaObject::invokeMethod(m_mainWindow, "openFile", Q_ARG(QString, themePath));
+        QMetaObject::invokeMethod(m_mainWindow->centralWidget(), "openFileAtPath", Q_ARG(QString, themePath));
 
         themeWatcher->addPath(themePath);
         applyTheme(themePath, true);
@@ -484,71 +604,176 @@ private:
                                      .arg(originalName).arg(themePath));
     }
 
+    void reloadThemeInBackground() {
+        const QString path = currentThemePath;
+        const quint64 generation = ++themeReloadGeneration;
+        QPointer<LookAndFeelCorePlugin> self(this);
+        QThreadPool::globalInstance()->start([self, path, generation]() {
+            QElapsedTimer clock;
+            clock.start();
+            QByteArray raw;
+            QFile file(path);
+            if (file.open(QIODevice::ReadOnly | QIODevice::Text))
+                raw = file.readAll();
+            const qint64 readMs = clock.restart();
+            const ParsedTheme parsed = raw.isEmpty() ? ParsedTheme() : parseTheme(raw);
+            const qint64 parseMs = clock.elapsed();
+
+            QMetaObject::invokeMethod(qApp, [self, path, generation, parsed, readMs, parseMs]() {
+                if (!self || generation != self->themeReloadGeneration) return;
+                self->finishThemeReload(path, parsed, readMs, parseMs);
+            }, Qt::QueuedConnection);
+        });
+    }
+
+    void finishThemeReload(const QString &path, const ParsedTheme &parsed, qint64 readMs, qint64 parseMs) {
+        if (!themeWatcher->files().contains(path) && QFile::exists(path))
+            themeWatcher->addPath(path);
+        if (path != currentThemePath) return;
+
+        if (!parsed.valid) {
+            if (themeReloadRetries++ < THEME_RELOAD_RETRIES) {
+                themeReloadTimer->start();
+                return;
+            }
+            m_mainWindow->statusBar()->showMessage(
+                QString("Theme %1 is incomplete or invalid; keeping the last good theme").arg(QFileInfo(path).fileName()), 4000);
+            return;
+        }
+        themeReloadRetries = 0;
+
+        if (parsed.hash == appliedThemeHash) return;
+        if (applyParsedTheme(path, parsed, readMs, parseMs))
+            m_mainWindow->statusBar()->showMessage("Theme hot-reloaded: " + QFileInfo(path).baseName(), 2000);
+    }
+
     void applyTheme(const QString &themeFilePath, bool saveAsCurrent) {
+        StartupTrace::Scope scope("applyTheme " + QFileInfo(themeFilePath).fileName(), "theme");
+        QElapsedTimer clock;
+        clock.start();
+
         QFile file(themeFilePath);
         if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
             m_mainWindow->statusBar()->showMessage("Failed to load theme: " + themeFilePath, 3000);
             return;
         }
 
-        QString qssContent = QString::fromUtf8(file.readAll());
+        const QByteArray raw = file.readAll();
         file.close();
+        const qint64 readMs = clock.restart();
 
-        QMap<QString, QString> vexProps = extractVexProperties(qssContent);
-
-        Settings &s = Settings::instance();
-        if (vexProps.contains("line-highlight-color"))
-            s.setValue("theme/lineHighlightColor", vexProps["line-highlight-color"]);
-        if (vexProps.contains("line-number-color-fg"))
-            s.setValue("theme/lineNumberFg", vexProps["line-number-color-fg"]);
-        if (vexProps.contains("line-number-color-bg"))
-            s.setValue("theme/lineNumberBg", vexProps["line-number-color-bg"]);
-        if (vexProps.contains("line-number-width"))
-            s.setValue("theme/lineNumberWidth", vexProps["line-number-width"]);
-        if (vexProps.contains("comment"))
-            s.setValue("theme/commentColor", vexProps["comment"]);
-        if (vexProps.contains("critical"))
-            s.setValue("theme/criticalColor", vexProps["critical"]);
-        if (vexProps.contains("quote"))
-            s.setValue("theme/quoteColor", vexProps["quote"]);
-        if (vexProps.contains("keyword"))
-            s.setValue("theme/keywordColor", vexProps["keyword"]);
-        if (vexProps.contains("string"))
-            s.setValue("theme/stringColor", vexProps["string"]);
-
-        QMap<QString, QColor> syntaxColors;
-        for (const QString &key : {"comment", "critical", "quote", "keyword", "string"}) {
-            if (vexProps.contains(key)) {
-                QColor color(vexProps[key]);
-                if (color.isValid())
-                    syntaxColors[key] = color;
-            }
+        if (saveAsCurrent) {
+            Settings::instance().setValue("currentThemePath", themeFilePath);
+            currentThemePath = themeFilePath;
         }
 
-        if (!syntaxColors.isEmpty())
-            QApplication::postEvent(m_mainWindow, new SyntaxColorEvent(syntaxColors));
-
-        QTabWidget *tabWidget = m_mainWindow->findChild<QTabWidget*>("VexTab");
-        if (tabWidget) {
-            tabWidget->setDocumentMode(false);
-            tabWidget->setElideMode(Qt::ElideNone);
-            QTabBar *tabBar = tabWidget->tabBar();
-            if (tabBar) {
-                tabBar->setExpanding(true);
-                tabBar->setDrawBase(true);
-                tabBar->setStyleSheet("");
-            }
+        const QByteArray contentHash = QCryptographicHash::hash(raw, QCryptographicHash::Sha1);
+        if (contentHash == appliedThemeHash) return;
+
+        const ParsedTheme parsed = parseTheme(raw);
+        applyParsedTheme(themeFilePath, parsed, readMs, clock.elapsed());
+    }
+
+    // Thread-safe. The stylesheet is reduced to a list of normalized rules
+    // (comments and whitespace dropped, VEX#QSS block removed) so edits that
+    // do not change any rule can skip re-polishing. A theme with unbalanced
+    // braces or no content is treated as mid-write.
+    static ParsedTheme parseTheme(const QByteArray &raw) {
+        static const QRegularExpression commentRe(R"(/\*.*?\*/)", QRegularExpression::DotMatchesEverythingOption);
+        static const QRegularExpression vexBlockRe(R"(VEX#QSS\s*\{[^}]*\})");
+
+        ParsedTheme parsed;
+        parsed.hash = QCryptographicHash::hash(raw, QCryptographicHash::Sha1);
+        parsed.qss = QString::fromUtf8(raw);
+        parsed.vexProps = extractVexProperties(parsed.qss);
+
+        QString styleSheet = parsed.qss;
+        styleSheet.remove(commentRe);
+        styleSheet.remove(vexBlockRe);
+        parsed.valid = !parsed.qss.trimmed().isEmpty() && styleSheet.count('{') == styleSheet.count('}');
+
+        const QStringList chunks = styleSheet.split('}');
+        for (const QString &chunk : chunks) {
+            const QString rule = chunk.simplified();
+            if (!rule.isEmpty())
+                parsed.rules.append(rule + " }");
         }
+        return parsed;
+    }
 
-        qApp->setStyleSheet(qssContent);
+    // Returns true when anything was applied. Only a changed rule list goes
+    // through qApp->setStyleSheet(); VEX#QSS-only edits just update colors.
+    bool applyParsedTheme(const QString &themeFilePath, const ParsedTheme &parsed, qint64 readMs, qint64 parseMs) {
+        QElapsedTimer clock;
+        clock.start();
+        appliedThemeHash = parsed.hash;
+
+        const bool recolor = parsed.vexProps != appliedVexProps;
+        const bool restyle = parsed.rules != appliedRules;
+        if (!recolor && !restyle) return false;
+
+        if (recolor) {
+            static const QList<QPair<const char*, const char*>> themeKeys = {
+                {"line-highlight-color", "theme/lineHighlightColor"},
+                {"line-number-color-fg", "theme/lineNumberFg"},
+                {"line-number-color-bg", "theme/lineNumberBg"},
+                {"line-number-width",    "theme/lineNumberWidth"},
+                {"comment",              "theme/commentColor"},
+                {"critical",             "theme/criticalColor"},
+                {"quote",                "theme/quoteColor"},
+                {"keyword",              "theme/keywordColor"},
+                {"string",               "theme/stringColor"},
+            };
+            QHash<QString, QVariant> themeValues;
+            for (const auto &[prop, key] : themeKeys) {
+                if (parsed.vexProps.contains(prop))
+                    themeValues.insert(key, parsed.vexProps[prop]);
+            }
+            Settings::instance().setValues(themeValues);
+
+            QMap<QString, QColor> syntaxColors;
+            for (const QString &key : {"comment", "critical", "quote", "keyword", "string"}) {
+                if (parsed.vexProps.contains(key)) {
+                    QColor color(parsed.vexProps[key]);
+                    if (color.isValid())
+                        syntaxColors[key] = color;
+                }
+            }
 
-        if (saveAsCurrent) {
-            s.setValue("currentThemePath", themeFilePath);
-            currentThemePath = themeFilePath;
+            if (!syntaxColors.isEmpty())
+                QApplication::postEvent(m_mainWindow, new SyntaxColorEvent(syntaxColors));
+            appliedVexProps = parsed.vexProps;
         }
+        const qint64 settingsMs = clock.restart();
+
+        if (restyle) {
+            appliedRules = parsed.rules;
+
+            QTabWidget *tabWidget = m_mainWindow->findChild<QTabWidget*>("VexTab");
+            if (tabWidget) {
+                tabWidget->setDocumentMode(false);
+                tabWidget->setElideMode(Qt::ElideNone);
+                QTabBar *tabBar = tabWidget->tabBar();
+                if (tabBar) {
+                    tabBar->setExpanding(true);
+                    tabBar->setDrawBase(true);
+                    tabBar->setStyleSheet("");
+                }
+            }
+
+            m_mainWindow->setUpdatesEnabled(false);
+            qApp->setStyleSheet(parsed.qss);
+            m_mainWindow->setUpdatesEnabled(true);
+        }
+
+        if (PluginLoader::isDebugMode())
+            qDebug().noquote() << QString("Theme %1: read %2 ms, parse %3 ms, settings %4 ms, polish %5 ms")
+                                      .arg(QFileInfo(themeFilePath).fileName())
+                                      .arg(readMs).arg(parseMs).arg(settingsMs).arg(clock.elapsed());
+        return true;
     }
 
-    QMap<QString, QString> extractVexProperties(const QString &qssContent) {
+    static QMap<QString, QString> extractVexProperties(const QString &qssContent) {
         QMap<QString, QString> properties;
         QRegularExpression vexBlockRe(R"(VEX#QSS\s*\{([^}]*)\})");
         QRegularExpressionMatch match = vexBlockRe.match(qssContent);
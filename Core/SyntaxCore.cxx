@@ -11,6 +11,7 @@
 #include <QtPlugin>
 #include <QSyntaxHighlighter>
 #include <QTextDocument>
+#include <QTextBlock>
 #include <QTextCharFormat>
 #include <QBrush>
 #include <QColor>
@@ -357,10 +358,10 @@ private:
     }
 };
 
-class SyntaxCorePlugin : public QObject, public CorePlugin {
+class SyntaxCorePlugin : public QObject, public CorePlugin, public DeferredPlugin {
     Q_OBJECT
-    Q_PLUGIN_METADATA(IID "vex.core/4.0")
-    Q_INTERFACES(CorePlugin)
+    Q_PLUGIN_METADATA(IID "vex.core/4.0" FILE "SyntaxCore.json")
+    Q_INTERFACES(CorePlugin DeferredPlugin)
 
 public:
     PluginMetadata meta() const override {
@@ -395,32 +396,41 @@ public:
         watcher = new QFileSystemWatcher(this);
         watcher->addPath(syntaxDir);
 
-        QString configPath = Settings::instance().configFilePath();
-        if (QFile::exists(configPath)) {
-            watcher->addPath(configPath);
-        }
+        Settings::instance().subscribe("theme/*", this, [this](const QStringList &) {
+            for (TextPainter *painter : std::as_const(painters)) {
+                painter->refreshColors();
+            }
+        });
 
         connect(watcher, &QFileSystemWatcher::directoryChanged,
                 this, &SyntaxCorePlugin::onDirectoryChanged);
         connect(watcher, &QFileSystemWatcher::fileChanged,
                 this, &SyntaxCorePlugin::onFileChanged);
 
+        connect(tabs, &QTabWidget::currentChanged,
+                this, &SyntaxCorePlugin::onTabSwitched);
+        connect(tabs, &QTabWidget::tabCloseRequested,
+                this, &SyntaxCorePlugin::onTabClosed);
+
+        return true;
+    }
+
+    void afterFirstPaint() override {
+        if (!selector) return;
+
         scanFiles();
         buildSelector();
 
         connect(selector, QOverload<int>::of(&QComboBox::currentIndexChanged),
                 this, &SyntaxCorePlugin::onSelectionChanged);
 
-        connect(tabs, &QTabWidget::currentChanged,
-                this, &SyntaxCorePlugin::onTabSwitched);
-        connect(tabs, &QTabWidget::tabCloseRequested,
-                this, &SyntaxCorePlugin::onTabClosed);
-
         attachToEditors();
+        if (tabs->currentIndex() >= 0) {
+            onTabSwitched(tabs->currentIndex());
+            onSelectionChanged(selector->currentIndex());
+        }
 
         mainWin->statusBar()->showMessage("Syntax highlighting..", 2000);
-
-        return true;
     }
 
 private slots:
@@ -434,6 +444,7 @@ private slots:
         QWidget *w = tabs->widget(currentTab);
         QPlainTextEdit *editor = qobject_cast<QPlainTextEdit*>(w);
         if (!editor) return;
+        editor->setProperty("vexSyntax", choice == "AUTO" ? QString() : choice);
 
         TextPainter *painter = painters.value(editor);
         if (!painter) {
@@ -475,7 +486,13 @@ private slots:
             selector->setCurrentIndex(0);
             return;
         }
-        selector->setCurrentIndex(0);
+        QString saved = tabs->widget(idx)->property("vexSyntax").toString();
+        int target = saved.isEmpty() ? 0 : qMax(0, selector->findData(saved));
+        if (target != 0 && target == selector->currentIndex()) {
+            onSelectionChanged(target);
+            return;
+        }
+        selector->setCurrentIndex(target);
     }
 
     void onTabClosed(int idx) {
@@ -493,13 +510,6 @@ private slots:
     }
 
     void onFileChanged(const QString &path) {
-        if (path.endsWith(".conf")) {
-            for (TextPainter *painter : std::as_const(painters)) {
-                painter->refreshColors();
-            }
-            return;
-        }
-
         if (!watcher->files().contains(path)) {
             watcher->addPath(path);
         }
@@ -516,10 +526,6 @@ private slots:
             watcher->removePaths(watched);
         }
         watcher->addPath(syntaxDir);
-        QString configPath = Settings::instance().configFilePath();
-        if (QFile::exists(configPath)) {
-            watcher->addPath(configPath);
-        }
 
         scanFiles();
         buildSelector();
@@ -573,12 +579,9 @@ private:
 
         if (!editor) return QString();
 
-        QString content = editor->toPlainText();
-        QStringList lines = content.split('\n');
-        int checkLines = qMin(10, lines.size());
-
-        for (int i = 0; i < checkLines; ++i) {
-            QString line = lines[i].trimmed();
+        QTextBlock block = editor->document()->firstBlock();
+        for (int i = 0; i < 10 && block.isValid(); ++i, block = block.next()) {
+            QString line = block.text().trimmed();
             if (line.isEmpty()) continue;
 
             for (auto it = syntaxFiles.constBegin(); it != syntaxFiles.constEnd(); ++it) {
@@ -642,6 +645,7 @@ private:
     }
 
     void scanFiles() {
+        StartupTrace::Scope scope("syntax scan", "syntax");
         QDir dir(syntaxDir);
         QStringList filters;
         filters << "*.vxsyn";
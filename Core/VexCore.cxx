@@ -10,6 +10,7 @@
 #include <QMainWindow>
 #include <QFileIconProvider>
 #include <QTabWidget>
+#include <QTabBar>
 #include <QMenuBar>
 #include <QMenu>
 #include <QAction>
@@ -56,19 +57,202 @@
 #include <QSize>
 #include <QStackedWidget>
 #include <QActionGroup>
+#include <QSharedPointer>
+#include <QThread>
+#include <QDataStream>
+#include <QDateTime>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QScrollBar>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QCryptographicHash>
+#include <QtEndian>
+#include <QRegularExpression>
+#include <QMouseEvent>
+#include <QPointer>
+#include <algorithm>
+#include <climits>
 #include <functional>
+#include <memory>
+#include <utility>
 #include "Plugvex.H"
 #include "Settings.H"
+#ifdef Q_OS_WIN
+#include <io.h>
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <cerrno>
+#endif
 
 
 class VexEditor;
 class LineNumberArea;
 class VexWidget;
+class AutosaveJournal;
+
+static bool isProcessAlive(qint64 pid) {
+    if (pid <= 0) return false;
+#ifdef Q_OS_WIN
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, DWORD(pid));
+    if (!process) return GetLastError() == ERROR_ACCESS_DENIED;
+    DWORD code = 0;
+    bool alive = GetExitCodeProcess(process, &code) && code == STILL_ACTIVE;
+    CloseHandle(process);
+    return alive;
+#elif defined(Q_OS_LINUX)
+    return QFileInfo::exists(QString("/proc/%1").arg(pid));
+#else
+    return ::kill(pid_t(pid), 0) == 0 || errno == EPERM;
+#endif
+}
+
+class InstanceRegistry {
+public:
+    static qint64 stamp() {
+        static const qint64 value = QDateTime::currentMSecsSinceEpoch();
+        return value;
+    }
+
+    static QString key() {
+        return QString("%1-%2").arg(QCoreApplication::applicationPid()).arg(stamp());
+    }
+
+    static QString directory() {
+        QString dir = Settings::basePath() + "/.temp/instances";
+        QDir().mkpath(dir);
+        return dir;
+    }
+
+    static void registerSelf() {
+        static bool registered = false;
+        if (registered) return;
+        registered = true;
+
+        // The lock is taken on a temporary name and only then renamed into
+        // place, so a probe can never see an unlocked <key>.lock of a live
+        // instance and reclaim it.
+        const QString path = directory() + "/" + key() + ".lock";
+        const QString staging = directory() + "/" + key() + ".tmp";
+#ifndef Q_OS_WIN
+        int fd = ::open(QFile::encodeName(staging).constData(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            qWarning() << "Vex: cannot create instance lock" << staging;
+            return;
+        }
+        if (::flock(fd, LOCK_EX) != 0
+            || ::rename(QFile::encodeName(staging).constData(), QFile::encodeName(path).constData()) != 0) {
+            qWarning() << "Vex: cannot register instance lock" << path;
+            ::close(fd);
+            QFile::remove(staging);
+            return;
+        }
+        QObject::connect(qApp, &QCoreApplication::aboutToQuit, [path, fd]() {
+            QFile::remove(path);
+            ::close(fd);
+        });
+#else
+        HANDLE handle = openLockFile(staging, CREATE_ALWAYS);
+        if (handle == INVALID_HANDLE_VALUE) {
+            qWarning() << "Vex: cannot create instance lock" << staging;
+            return;
+        }
+        OVERLAPPED region = {};
+        if (!LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &region)
+            || !MoveFileExW(reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(staging).utf16()),
+                            reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(path).utf16()),
+                            MOVEFILE_REPLACE_EXISTING)) {
+            qWarning() << "Vex: cannot register instance lock" << path;
+            CloseHandle(handle);
+            QFile::remove(staging);
+            return;
+        }
+        QObject::connect(qApp, &QCoreApplication::aboutToQuit, [path, handle]() {
+            OVERLAPPED region = {};
+            UnlockFileEx(handle, 0, 1, 0, &region);
+            CloseHandle(handle);
+            QFile::remove(path);
+        });
+#endif
+    }
+
+    static QSet<QString> liveInstances() {
+        QSet<QString> live;
+        live.insert(key());
+
+        QDir dir(directory());
+        const QStringList entries = dir.entryList(QStringList() << "*.lock", QDir::Files);
+        for (const QString &name : entries) {
+            const QString path = dir.absoluteFilePath(name);
+            const QString instance = name.chopped(5);
+            if (instance == key()) continue;
+            if (isHeld(path, instance.section('-', 0, 0).toLongLong()))
+                live.insert(instance);
+            else
+                QFile::remove(path);
+        }
+        // Staging files left behind by an instance that died while registering
+        const QDateTime cutoff = QDateTime::currentDateTime().addSecs(-STALE_STAGING_SECS);
+        const QFileInfoList staged = dir.entryInfoList(QStringList() << "*.tmp", QDir::Files);
+        for (const QFileInfo &info : staged) {
+            if (info.lastModified() < cutoff) QFile::remove(info.absoluteFilePath());
+        }
+        return live;
+    }
+
+private:
+    static constexpr int STALE_STAGING_SECS = 60;
+
+    static bool isHeld(const QString &path, qint64 pid) {
+#ifndef Q_OS_WIN
+        int fd = ::open(QFile::encodeName(path).constData(), O_RDWR | O_CLOEXEC);
+        if (fd < 0) return isProcessAlive(pid);
+        bool held = ::flock(fd, LOCK_EX | LOCK_NB) != 0 && errno == EWOULDBLOCK;
+        ::close(fd);
+        return held;
+#else
+        HANDLE handle = openLockFile(path, OPEN_EXISTING);
+        if (handle == INVALID_HANDLE_VALUE)
+            return GetLastError() == ERROR_FILE_NOT_FOUND ? false : isProcessAlive(pid);
+        OVERLAPPED region = {};
+        const bool held = !LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &region)
+                          && GetLastError() == ERROR_LOCK_VIOLATION;
+        if (!held) UnlockFileEx(handle, 0, 1, 0, &region);
+        CloseHandle(handle);
+        return held;
+#endif
+    }
+
+#ifdef Q_OS_WIN
+    // Fully shared so other instances can probe the lock and the owner can
+    // delete the file on exit; the byte-range lock dies with the process.
+    static HANDLE openLockFile(const QString &path, DWORD disposition) {
+        return CreateFileW(reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(path).utf16()),
+                           GENERIC_READ | GENERIC_WRITE,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+    }
+#endif
+};
 
 class Mode {
 public:
     enum ModeEnum { MODE_INS, MODE_Vi, MODE_CMD };
 
+    struct Key {
+        int                   key;
+        Qt::KeyboardModifiers modifiers;
+        QString               text;
+    };
+
     ModeEnum current() const { return m_mode; }
 
     void init(QPushButton *btn,
@@ -77,7 +261,8 @@ public:
               std::function<void(const QString &)>       cbCmdChanged,
               std::function<void(const QString &, bool)> cbCmdExecuted,
               std::function<void(ModeEnum)>              cbModeChanged,
-              std::function<void(QKeyEvent *)>           cbDefaultKey)
+              std::function<void(QKeyEvent *)>           cbDefaultKey,
+              std::function<void(bool)>                  cbQuitReq)
     {
         m_btn           = btn;
         m_cbSaveReq     = cbSaveReq;
@@ -86,6 +271,7 @@ public:
         m_cbCmdExecuted = cbCmdExecuted;
         m_cbModeChanged = cbModeChanged;
         m_cbDefaultKey  = cbDefaultKey;
+        m_cbQuitReq     = cbQuitReq;
     }
 
     void setupButton() {
@@ -122,6 +308,7 @@ public:
     }
 
     void Vi() {
+        if (m_mode == MODE_INS) endInsertRecording();
         m_mode = ModeEnum::MODE_Vi;
         saveMODE();
         m_btn->setText("VI");
@@ -148,6 +335,7 @@ public:
     }
 
     void CMD() {
+        if (m_mode == MODE_INS) endInsertRecording();
         m_mode = ModeEnum::MODE_CMD;
         m_cmdLine = ":";
         m_cbCmdChanged(m_cmdLine);
@@ -162,7 +350,18 @@ public:
     }
 
     void handleKey(QPlainTextEdit *ed, QKeyEvent *e) {
+        if (!m_recording.isNull() && !m_replaying) {
+            m_recordedKeys.append({e->key(), e->modifiers(), e->text()});
+        }
+        if (m_insertRecording && m_mode == MODE_INS) {
+            m_changeKeys.append({e->key(), e->modifiers(), e->text()});
+        }
         if (e->key() == Qt::Key_Escape) {
+            if (m_mode == MODE_Vi && pending()) {
+                resetPending();
+                m_cbVimKey("");
+                return;
+            }
             changeMODE();
             return;
         }
@@ -174,11 +373,23 @@ public:
             handleViKey(ed, e);
             break;
         case ModeEnum::MODE_CMD:
-            handleCmdKey(e);
+            handleCmdKey(ed, e);
             break;
         }
     }
 
+    // Feeds keys through handleKey as if typed, e.g. for '.'. Callers wrap
+    // this in an edit block so the whole replay undoes as one step.
+    void replay(QPlainTextEdit *ed, const QList<Key> &keys) {
+        const bool wasReplaying = m_replaying;
+        m_replaying = true;
+        for (const Key &key : keys) {
+            QKeyEvent event(QEvent::KeyPress, key.key, key.modifiers, key.text);
+            handleKey(ed, &event);
+        }
+        m_replaying = wasReplaying;
+    }
+
 private:
     ModeEnum    m_mode  = MODE_INS;
     QPushButton *m_btn  = nullptr;
@@ -190,117 +401,1239 @@ private:
     std::function<void(const QString &, bool)> m_cbCmdExecuted;
     std::function<void(ModeEnum)>              m_cbModeChanged;
     std::function<void(QKeyEvent *)>           m_cbDefaultKey;
+    std::function<void(bool)>                  m_cbQuitReq;
+
+    // Vi engine. A command is [count]["x][count]operator[count]motion or
+    // [count]["x]command; every key is looked up in the tables below rather
+    // than special-cased, and each finished command runs as one edit block.
+    enum MotionKind { Exclusive, Inclusive, Linewise };
+    using MotionFn  = bool (*)(QTextDocument *doc, int &pos, int count, QChar arg);
+    using CommandFn = void (*)(Mode &mode, QPlainTextEdit *ed, int count, QChar arg);
+
+    struct Motion {
+        MotionFn   move;
+        MotionKind kind;
+    };
 
-    void handleViKey(QPlainTextEdit *ed, QKeyEvent *e) {
-        QTextCursor cursor = ed->textCursor();
+    struct Command {
+        CommandFn run;
+        bool      change;
+        bool      enterInsert;
+    };
 
-        if (e->key() == Qt::Key_I) {
+    struct Register {
+        QString text;
+        bool    linewise = false;
+    };
+
+    QString     m_sequence;
+    QString     m_prefix;
+    QString     m_operator;
+    int         m_count    = 0;
+    int         m_opCount  = 0;
+    QChar       m_register;
+    QList<Key>  m_changeKeys;
+    QList<Key>  m_lastChange;
+    bool        m_insertRecording = false;
+    bool        m_replaying       = false;
+    QChar       m_recording;
+    QList<Key>  m_recordedKeys;
+    QChar       m_lastMacro;
+    int         m_macroDepth      = 0;
+
+    static constexpr int MAX_MACRO_DEPTH = 32;
+
+    static QHash<QChar, QList<Key>> &macros() {
+        static QHash<QChar, QList<Key>> recorded;
+        return recorded;
+    }
+
+    static QHash<QChar, Register> &registers() {
+        static QHash<QChar, Register> regs;
+        return regs;
+    }
+
+    static QChar &lastFind() {
+        static QChar find;
+        return find;
+    }
+
+    static QChar &lastFindChar() {
+        static QChar ch;
+        return ch;
+    }
+
+    static int charClass(QChar c, bool bigWord) {
+        if (c.isSpace() || c == QChar::ParagraphSeparator || c.isNull()) return 0;
+        if (bigWord || c.isLetterOrNumber() || c == QLatin1Char('_')) return 1;
+        return 2;
+    }
+
+    static int lastPos(QTextDocument *doc) { return doc->characterCount() - 1; }
+
+    static int columnOf(QTextDocument *doc, int pos) { return pos - doc->findBlock(pos).position(); }
+
+    static int firstNonBlank(const QTextBlock &block) {
+        const QString text = block.text();
+        int col = 0;
+        while (col < text.size() && text.at(col).isSpace()) ++col;
+        return block.position() + col;
+    }
+
+    static bool moveToLine(QTextDocument *doc, int &pos, int line) {
+        QTextBlock block = doc->findBlockByNumber(qBound(0, line, doc->blockCount() - 1));
+        const int col = columnOf(doc, pos);
+        pos = block.position() + qMin(col, block.length() - 1);
+        return true;
+    }
+
+    static bool wordForward(QTextDocument *doc, int &pos, int count, bool bigWord) {
+        const int end = lastPos(doc);
+        for (int n = qMax(1, count); n > 0 && pos < end; --n) {
+            const int cls = charClass(doc->characterAt(pos), bigWord);
+            if (cls != 0) {
+                while (pos < end && charClass(doc->characterAt(pos), bigWord) == cls) ++pos;
+            }
+            while (pos < end && charClass(doc->characterAt(pos), bigWord) == 0) ++pos;
+        }
+        return true;
+    }
+
+    static bool wordBackward(QTextDocument *doc, int &pos, int count, bool bigWord) {
+        for (int n = qMax(1, count); n > 0 && pos > 0; --n) {
+            --pos;
+            while (pos > 0 && charClass(doc->characterAt(pos), bigWord) == 0) --pos;
+            const int cls = charClass(doc->characterAt(pos), bigWord);
+            while (pos > 0 && charClass(doc->characterAt(pos - 1), bigWord) == cls) --pos;
+        }
+        return true;
+    }
+
+    static bool wordEnd(QTextDocument *doc, int &pos, int count, bool bigWord) {
+        const int end = lastPos(doc);
+        for (int n = qMax(1, count); n > 0 && pos < end - 1; --n) {
+            ++pos;
+            while (pos < end && charClass(doc->characterAt(pos), bigWord) == 0) ++pos;
+            const int cls = charClass(doc->characterAt(pos), bigWord);
+            while (pos + 1 < end && charClass(doc->characterAt(pos + 1), bigWord) == cls) ++pos;
+        }
+        return true;
+    }
+
+    static bool findInLine(QTextDocument *doc, int &pos, int count, QChar kind, QChar target) {
+        const QTextBlock block = doc->findBlock(pos);
+        const QString text = block.text();
+        const bool forward = kind == QLatin1Char('f') || kind == QLatin1Char('t');
+        const bool till = kind == QLatin1Char('t') || kind == QLatin1Char('T');
+        int col = pos - block.position();
+        for (int n = qMax(1, count); n > 0; --n) {
+            const int from = forward ? col + 1 : col - 1;
+            if (from < 0 || from >= text.size()) return false;
+            const int next = forward ? text.indexOf(target, from) : text.lastIndexOf(target, from);
+            if (next < 0) return false;
+            col = next;
+        }
+        if (till) col += forward ? -1 : 1;
+        pos = block.position() + col;
+        return true;
+    }
+
+    static bool matchBracket(QTextDocument *doc, int &pos) {
+        static const QString open = "([{", close = ")]}";
+        const QTextBlock block = doc->findBlock(pos);
+        const QString text = block.text();
+        int col = pos - block.position();
+        while (col < text.size() && !open.contains(text.at(col)) && !close.contains(text.at(col))) ++col;
+        if (col >= text.size()) return false;
+
+        const QChar c = text.at(col);
+        const bool forward = open.contains(c);
+        const QChar match = forward ? close.at(open.indexOf(c)) : open.at(close.indexOf(c));
+        int depth = 0;
+        const int end = lastPos(doc);
+        for (int p = block.position() + col; p >= 0 && p < end; p += forward ? 1 : -1) {
+            const QChar ch = doc->characterAt(p);
+            if (ch == c) ++depth;
+            else if (ch == match && --depth == 0) {
+                pos = p;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool paragraph(QTextDocument *doc, int &pos, int count, bool forward) {
+        QTextBlock block = doc->findBlock(pos);
+        for (int n = qMax(1, count); n > 0; --n) {
+            QTextBlock next = forward ? block.next() : block.previous();
+            while (next.isValid() && next.text().trimmed().isEmpty()) next = forward ? next.next() : next.previous();
+            while (next.isValid() && !next.text().trimmed().isEmpty()) next = forward ? next.next() : next.previous();
+            if (!next.isValid()) {
+                pos = forward ? lastPos(doc) : 0;
+                return true;
+            }
+            block = next;
+        }
+        pos = block.position();
+        return true;
+    }
+
+    static const QHash<QString, Motion> &motions() {
+        static const QHash<QString, Motion> table = {
+            {"h", {[](QTextDocument *doc, int &pos, int count, QChar) {
+                pos = qMax(doc->findBlock(pos).position(), pos - qMax(1, count)); return true; }, Exclusive}},
+            {"l", {[](QTextDocument *doc, int &pos, int count, QChar) {
+                const QTextBlock b = doc->findBlock(pos);
+                pos = qMin(b.position() + b.length() - 1, pos + qMax(1, count)); return true; }, Exclusive}},
+            {"j", {[](QTextDocument *doc, int &pos, int count, QChar) {
+                return moveToLine(doc, pos, doc->findBlock(pos).blockNumber() + qMax(1, count)); }, Linewise}},
+            {"k", {[](QTextDocument *doc, int &pos, int count, QChar) {
+                return moveToLine(doc, pos, doc->findBlock(pos).blockNumber() - qMax(1, count)); }, Linewise}},
+            {"+", {[](QTextDocument *doc, int &pos, int count, QChar) {
+                pos = firstNonBlank(doc->findBlockByNumber(qMin(doc->blockCount() - 1,
+                        doc->findBlock(pos).blockNumber() + qMax(1, count)))); return true; }, Linewise}},
+            {"-", {[](QTextDocument *doc, int &pos, int count, QChar) {
+                pos = firstNonBlank(doc->findBlockByNumber(qMax(0,
+                        doc->findBlock(pos).blockNumber() - qMax(1, count)))); return true; }, Linewise}},
+            {"w", {[](QTextDocument *doc, int &pos, int count, QChar) { return wordForward(doc, pos, count, false); }, Exclusive}},
+            {"W", {[](QTextDocument *doc, int &pos, int count, QChar) { return wordForward(doc, pos, count, true); }, Exclusive}},
+            {"b", {[](QTextDocument *doc, int &pos, int count, QChar) { return wordBackward(doc, pos, count, false); }, Exclusive}},
+            {"B", {[](QTextDocument *doc, int &pos, int count, QChar) { return wordBackward(doc, pos, count, true); }, Exclusive}},
+            {"e", {[](QTextDocument *doc, int &pos, int count, QChar) { return wordEnd(doc, pos, count, false); }, Inclusive}},
+            {"E", {[](QTextDocument *doc, int &pos, int count, QChar) { return wordEnd(doc, pos, count, true); }, Inclusive}},
+            {"0", {[](QTextDocument *doc, int &pos, int, QChar) { pos = doc->findBlock(pos).position(); return true; }, Exclusive}},
+            {"^", {[](QTextDocument *doc, int &pos, int, QChar) { pos = firstNonBlank(doc->findBlock(pos)); return true; }, Exclusive}},
+            {"$", {[](QTextDocument *doc, int &pos, int count, QChar) {
+                const QTextBlock b = doc->findBlockByNumber(qMin(doc->blockCount() - 1,
+                        doc->findBlock(pos).blockNumber() + qMax(1, count) - 1));
+                pos = qMax(b.position(), b.position() + b.length() - 2); return true; }, Inclusive}},
+            {"gg", {[](QTextDocument *doc, int &pos, int count, QChar) {
+                pos = firstNonBlank(doc->findBlockByNumber(qBound(0, qMax(1, count) - 1, doc->blockCount() - 1)));
+                return true; }, Linewise}},
+            {"G", {[](QTextDocument *doc, int &pos, int count, QChar) {
+                const int line = count > 0 ? count - 1 : doc->blockCount() - 1;
+                pos = firstNonBlank(doc->findBlockByNumber(qBound(0, line, doc->blockCount() - 1)));
+                return true; }, Linewise}},
+            {"}", {[](QTextDocument *doc, int &pos, int count, QChar) { return paragraph(doc, pos, count, true); }, Exclusive}},
+            {"{", {[](QTextDocument *doc, int &pos, int count, QChar) { return paragraph(doc, pos, count, false); }, Exclusive}},
+            {"%", {[](QTextDocument *doc, int &pos, int, QChar) { return matchBracket(doc, pos); }, Inclusive}},
+            {"f", {[](QTextDocument *doc, int &pos, int count, QChar c) { return findInLine(doc, pos, count, 'f', c); }, Inclusive}},
+            {"F", {[](QTextDocument *doc, int &pos, int count, QChar c) { return findInLine(doc, pos, count, 'F', c); }, Exclusive}},
+            {"t", {[](QTextDocument *doc, int &pos, int count, QChar c) { return findInLine(doc, pos, count, 't', c); }, Inclusive}},
+            {"T", {[](QTextDocument *doc, int &pos, int count, QChar c) { return findInLine(doc, pos, count, 'T', c); }, Exclusive}},
+            {";", {[](QTextDocument *doc, int &pos, int count, QChar) {
+                return !lastFind().isNull() && findInLine(doc, pos, count, lastFind(), lastFindChar()); }, Inclusive}},
+            {",", {[](QTextDocument *doc, int &pos, int count, QChar) {
+                static const QHash<QChar, QChar> reverse = {{'f', 'F'}, {'F', 'f'}, {'t', 'T'}, {'T', 't'}};
+                return !lastFind().isNull() && findInLine(doc, pos, count, reverse.value(lastFind()), lastFindChar()); }, Exclusive}},
+        };
+        return table;
+    }
+
+    static const QHash<QString, QString> &aliases() {
+        static const QHash<QString, QString> table = {
+            {"x", "dl"}, {"X", "dh"}, {"D", "d$"}, {"C", "c$"},
+            {"s", "cl"}, {"S", "cc"}, {"Y", "yy"}, {"<CR>", "+"}, {" ", "l"},
+        };
+        return table;
+    }
+
+    static const QStringList &operators() {
+        static const QStringList table = {"d", "c", "y", ">", "<", "gu", "gU", "g~"};
+        return table;
+    }
+
+    static const QHash<QString, Command> &commands() {
+        static const QHash<QString, Command> table = {
+            {"i", {[](Mode &m, QPlainTextEdit *, int, QChar) { m.INS(); }, true, true}},
+            {"a", {[](Mode &m, QPlainTextEdit *ed, int, QChar) {
+                QTextCursor c = ed->textCursor();
+                if (!c.atBlockEnd()) c.movePosition(QTextCursor::Right);
+                ed->setTextCursor(c);
+                m.INS(); }, true, true}},
+            {"I", {[](Mode &m, QPlainTextEdit *ed, int, QChar) {
+                QTextCursor c = ed->textCursor();
+                c.setPosition(firstNonBlank(c.block()));
+                ed->setTextCursor(c);
+                m.INS(); }, true, true}},
+            {"A", {[](Mode &m, QPlainTextEdit *ed, int, QChar) {
+                QTextCursor c = ed->textCursor();
+                c.movePosition(QTextCursor::EndOfBlock);
+                ed->setTextCursor(c);
+                m.INS(); }, true, true}},
+            {"o", {[](Mode &m, QPlainTextEdit *ed, int, QChar) {
+                QTextCursor c = ed->textCursor();
+                c.movePosition(QTextCursor::EndOfBlock);
+                c.insertText("\n");
+                ed->setTextCursor(c);
+                m.INS(); }, true, true}},
+            {"O", {[](Mode &m, QPlainTextEdit *ed, int, QChar) {
+                QTextCursor c = ed->textCursor();
+                c.movePosition(QTextCursor::StartOfBlock);
+                c.insertText("\n");
+                c.movePosition(QTextCursor::PreviousBlock);
+                ed->setTextCursor(c);
+                m.INS(); }, true, true}},
+            {"p", {[](Mode &m, QPlainTextEdit *ed, int count, QChar) { m.put(ed, count, true); }, true, false}},
+            {"P", {[](Mode &m, QPlainTextEdit *ed, int count, QChar) { m.put(ed, count, false); }, true, false}},
+            {"J", {[](Mode &, QPlainTextEdit *ed, int count, QChar) {
+                QTextCursor c = ed->textCursor();
+                for (int n = qMax(1, count - 1); n > 0 && c.block().next().isValid(); --n) {
+                    c.movePosition(QTextCursor::EndOfBlock);
+                    const int joint = c.position();
+                    const QString next = c.block().next().text();
+                    int skip = 0;
+                    while (skip < next.size() && next.at(skip).isSpace()) ++skip;
+                    const bool space = skip < next.size() && !c.block().text().endsWith(' ');
+                    c.setPosition(joint + 1 + skip, QTextCursor::KeepAnchor);
+                    c.insertText(space ? " " : "");
+                    c.setPosition(joint);
+                }
+                ed->setTextCursor(c); }, true, false}},
+            {"r", {[](Mode &, QPlainTextEdit *ed, int count, QChar arg) {
+                QTextCursor c = ed->textCursor();
+                const int n = qMax(1, count);
+                if (c.positionInBlock() + n > c.block().length() - 1) return;
+                c.setPosition(c.position() + n, QTextCursor::KeepAnchor);
+                // r<CR> replaces the characters with a single line break
+                if (arg == QLatin1Char('\n')) {
+                    c.insertText(QString(arg));
+                } else {
+                    c.insertText(QString(n, arg));
+                    c.movePosition(QTextCursor::Left);
+                }
+                ed->setTextCursor(c); }, true, false}},
+            {"~", {[](Mode &, QPlainTextEdit *ed, int count, QChar) {
+                QTextCursor c = ed->textCursor();
+                const int end = qMin(c.position() + qMax(1, count), c.block().position() + c.block().length() - 1);
+                c.setPosition(end, QTextCursor::KeepAnchor);
+                QString text = c.selectedText();
+                for (QChar &ch : text) ch = ch.isUpper() ? ch.toLower() : ch.toUpper();
+                c.insertText(text);
+                ed->setTextCursor(c); }, true, false}},
+            {"u", {[](Mode &, QPlainTextEdit *ed, int count, QChar) {
+                for (int n = qMax(1, count); n > 0 && ed->document()->isUndoAvailable(); --n) ed->undo(); }, false, false}},
+            {"<C-r>", {[](Mode &, QPlainTextEdit *ed, int count, QChar) {
+                for (int n = qMax(1, count); n > 0 && ed->document()->isRedoAvailable(); --n) ed->redo(); }, false, false}},
+            {":", {[](Mode &m, QPlainTextEdit *, int, QChar) { m.CMD(); }, false, false}},
+            {"<C-w>", {[](Mode &m, QPlainTextEdit *, int, QChar) { m.m_cbSaveReq(); }, false, false}},
+        };
+        return table;
+    }
+
+    static QString keyName(const Key &key) {
+        switch (key.key) {
+        case Qt::Key_Escape:    return "<Esc>";
+        case Qt::Key_Return:
+        case Qt::Key_Enter:     return "<CR>";
+        case Qt::Key_Left:
+        case Qt::Key_Backspace: return "h";
+        case Qt::Key_Right:     return "l";
+        case Qt::Key_Up:        return "k";
+        case Qt::Key_Down:      return "j";
+        case Qt::Key_Home:      return "0";
+        case Qt::Key_End:       return "$";
+        default: break;
+        }
+        if ((key.modifiers & Qt::ControlModifier) && key.key >= Qt::Key_A && key.key <= Qt::Key_Z) {
+            return QString("<C-%1>").arg(QChar('a' + (key.key - Qt::Key_A)));
+        }
+        return key.text.size() == 1 && key.text.at(0).isPrint() ? key.text : QString();
+    }
+
+    static QString textBetween(QTextDocument *doc, int start, int end) {
+        QTextCursor c(doc);
+        c.setPosition(start);
+        c.setPosition(end, QTextCursor::KeepAnchor);
+        QString text = c.selectedText();
+        text.replace(QChar::ParagraphSeparator, QLatin1Char('\n'));
+        return text;
+    }
+
+    bool pending() const {
+        return !m_prefix.isEmpty() || !m_operator.isEmpty() || m_count > 0 || !m_register.isNull();
+    }
+
+    void resetPending() {
+        m_prefix.clear();
+        m_operator.clear();
+        m_sequence.clear();
+        m_count = 0;
+        m_opCount = 0;
+        m_register = QChar();
+        if (!m_insertRecording) m_changeKeys.clear();
+    }
+
+    void storeRegister(const QString &text, bool linewise, bool yank) {
+        const Register value{text, linewise};
+        QHash<QChar, Register> &regs = registers();
+        const QChar name = m_register;
+        if (name == QLatin1Char('+') || name == QLatin1Char('*')) {
+            QApplication::clipboard()->setText(text);
+        } else if (name.isUpper()) {
+            Register &target = regs[name.toLower()];
+            target.text += text;
+            target.linewise = target.linewise || linewise;
+        } else if (name.isLetter()) {
+            regs.insert(name, value);
+        }
+        regs.insert('"', value);
+        regs.insert(yank ? '0' : '1', value);
+        if (yank) QApplication::clipboard()->setText(text);
+    }
+
+    Register fetchRegister() const {
+        const QChar name = m_register.isNull() ? QChar('"') : m_register.toLower();
+        const QHash<QChar, Register> &regs = registers();
+        const bool clipboard = name == QLatin1Char('+') || name == QLatin1Char('*');
+        if (clipboard || (name == QLatin1Char('"') && !regs.contains(name))) {
+            const QString text = QApplication::clipboard()->text();
+            return {text, text.endsWith('\n')};
+        }
+        return regs.value(name);
+    }
+
+    void put(QPlainTextEdit *ed, int count, bool after) {
+        const Register reg = fetchRegister();
+        if (reg.text.isEmpty()) return;
+
+        QTextCursor c = ed->textCursor();
+        const QString payload = reg.text.repeated(qMax(1, count));
+        if (reg.linewise) {
+            QString lines = payload;
+            if (lines.endsWith('\n')) lines.chop(1);
+            if (after) {
+                const int line = c.blockNumber();
+                c.movePosition(QTextCursor::EndOfBlock);
+                c.insertText("\n" + lines);
+                c.setPosition(firstNonBlank(ed->document()->findBlockByNumber(line + 1)));
+            } else {
+                c.movePosition(QTextCursor::StartOfBlock);
+                const int start = c.position();
+                c.insertText(lines + "\n");
+                c.setPosition(firstNonBlank(ed->document()->findBlock(start)));
+            }
+        } else {
+            if (after && !c.atBlockEnd()) c.movePosition(QTextCursor::Right);
+            c.insertText(payload);
+            c.movePosition(QTextCursor::Left);
+        }
+        ed->setTextCursor(c);
+    }
+
+    // Applies m_operator to [start, end) and returns true when it left vi mode.
+    bool applyOperator(QPlainTextEdit *ed, int start, int end, bool linewise) {
+        QTextDocument *doc = ed->document();
+        QTextCursor c(doc);
+        const QString op = m_operator;
+
+        if (linewise) {
+            const QTextBlock first = doc->findBlock(start);
+            const QTextBlock last = doc->findBlock(end);
+            start = first.position();
+            end = last.position() + last.length() - 1;
+
+            if (op == ">" || op == "<") {
+                for (QTextBlock b = first; b.isValid() && b.blockNumber() <= last.blockNumber(); b = b.next()) {
+                    c.setPosition(b.position());
+                    if (op == ">") {
+                        if (!b.text().isEmpty()) c.insertText("    ");
+                    } else {
+                        const QString text = b.text();
+                        int strip = 0;
+                        if (text.startsWith('\t')) strip = 1;
+                        else while (strip < 4 && strip < text.size() && text.at(strip) == ' ') ++strip;
+                        c.setPosition(b.position() + strip, QTextCursor::KeepAnchor);
+                        c.removeSelectedText();
+                    }
+                }
+                c.setPosition(firstNonBlank(doc->findBlock(start)));
+                ed->setTextCursor(c);
+                return false;
+            }
+
+            const QString text = textBetween(doc, start, end) + "\n";
+            if (op == "y") {
+                storeRegister(text, true, true);
+                return false;
+            }
+            storeRegister(text, true, false);
+            c.setPosition(start);
+            if (op == "c") {
+                c.setPosition(end, QTextCursor::KeepAnchor);
+                c.removeSelectedText();
+                ed->setTextCursor(c);
+                INS();
+                return true;
+            }
+            if (end < lastPos(doc)) ++end;
+            else if (start > 0) c.setPosition(--start);
+            c.setPosition(end, QTextCursor::KeepAnchor);
+            c.removeSelectedText();
+            c.setPosition(firstNonBlank(doc->findBlock(qMin(start, lastPos(doc)))));
+            ed->setTextCursor(c);
+            return false;
+        }
+
+        c.setPosition(start);
+        c.setPosition(end, QTextCursor::KeepAnchor);
+        const QString text = textBetween(doc, start, end);
+        if (op == "y") {
+            storeRegister(text, false, true);
+            c.setPosition(start);
+        } else if (op == "d" || op == "c") {
+            storeRegister(text, false, false);
+            c.removeSelectedText();
+        } else if (op == ">" || op == "<") {
+            m_operator = op;
+            return applyOperator(ed, start, end, true);
+        } else {
+            QString changed = text;
+            for (QChar &ch : changed) {
+                if (op == "gu") ch = ch.toLower();
+                else if (op == "gU") ch = ch.toUpper();
+                else ch = ch.isUpper() ? ch.toLower() : ch.toUpper();
+            }
+            c.insertText(changed);
+            c.setPosition(start);
+        }
+        ed->setTextCursor(c);
+        if (op == "c") {
             INS();
-            m_cbVimKey("i");
+            return true;
+        }
+        return false;
+    }
+
+    // Resolves iw/aw/i"/a(/... to a range around the cursor.
+    static bool textObject(QTextDocument *doc, int pos, QChar kind, QChar object, int &start, int &end) {
+        const bool around = kind == QLatin1Char('a');
+        if (object == QLatin1Char('w') || object == QLatin1Char('W')) {
+            const bool big = object == QLatin1Char('W');
+            const int cls = charClass(doc->characterAt(pos), big);
+            const QTextBlock block = doc->findBlock(pos);
+            const int lineStart = block.position(), lineEnd = block.position() + block.length() - 1;
+            start = end = pos;
+            while (start > lineStart && charClass(doc->characterAt(start - 1), big) == cls) --start;
+            while (end < lineEnd && charClass(doc->characterAt(end), big) == cls) ++end;
+            if (around) {
+                while (end < lineEnd && charClass(doc->characterAt(end), big) == 0) ++end;
+            }
+            return end > start;
+        }
+
+        static const QString pairs = "(){}[]<>";
+        static const QHash<QChar, QChar> aliases = {{'b', '('}, {'B', '{'}};
+        const QChar key = aliases.value(object, object);
+        if (key == QLatin1Char('"') || key == QLatin1Char('\'') || key == QLatin1Char('`')) {
+            const QTextBlock block = doc->findBlock(pos);
+            const QString text = block.text();
+            const int col = pos - block.position();
+            QList<int> quotes;
+            for (int i = 0; i < text.size(); ++i) {
+                if (text.at(i) == key && (i == 0 || text.at(i - 1) != QLatin1Char('\\'))) quotes.append(i);
+            }
+            for (int i = 0; i + 1 < quotes.size(); i += 2) {
+                if (quotes.at(i + 1) < col) continue;
+                start = block.position() + quotes.at(i) + (around ? 0 : 1);
+                end = block.position() + quotes.at(i + 1) + (around ? 1 : 0);
+                return true;
+            }
+            return false;
+        }
+
+        const int index = pairs.indexOf(key);
+        if (index < 0) return false;
+        const QChar open = pairs.at(index - index % 2), close = pairs.at(index - index % 2 + 1);
+        int depth = 0, left = -1;
+        for (int p = pos; p >= 0; --p) {
+            const QChar ch = doc->characterAt(p);
+            if (ch == close && p != pos) ++depth;
+            else if (ch == open && depth-- == 0) { left = p; break; }
+        }
+        if (left < 0) return false;
+        depth = 0;
+        const int last = lastPos(doc);
+        for (int p = left + 1; p < last; ++p) {
+            const QChar ch = doc->characterAt(p);
+            if (ch == open) ++depth;
+            else if (ch == close && depth-- == 0) {
+                start = around ? left : left + 1;
+                end = around ? p + 1 : p;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Ends the current command: reports it, remembers it for '.' when it
+    // changed text (after the insert session it started, if any) and resets.
+    void finishCommand(bool change, bool enteredInsert) {
+        m_cbVimKey(m_sequence);
+        if (change && !m_replaying) {
+            if (enteredInsert) {
+                m_insertRecording = true;
+            } else {
+                m_lastChange = m_changeKeys;
+            }
+        }
+        resetPending();
+    }
+
+    // Leaving insert mode by any route (Escape, the mode button) closes the
+    // change '.' repeats; the replay must end back in Vi mode too.
+    void endInsertRecording() {
+        if (!m_insertRecording) return;
+        if (m_changeKeys.isEmpty() || m_changeKeys.last().key != Qt::Key_Escape)
+            m_changeKeys.append({Qt::Key_Escape, Qt::NoModifier, QString()});
+        m_lastChange = m_changeKeys;
+        m_insertRecording = false;
+        m_changeKeys.clear();
+    }
+
+    void repeatLastChange(QPlainTextEdit *ed, int count) {
+        QList<Key> keys = m_lastChange;
+        if (keys.isEmpty()) return;
+        if (count > 0) {
+            if (!keys.isEmpty() && keys.first().text.size() == 1 && keys.first().text != "0") {
+                while (!keys.isEmpty() && keys.first().text.size() == 1 && keys.first().text.at(0).isDigit()) {
+                    keys.removeFirst();
+                }
+            }
+            const QString digits = QString::number(count);
+            for (int i = digits.size() - 1; i >= 0; --i) {
+                keys.prepend({Qt::Key_0 + digits.at(i).digitValue(), Qt::NoModifier, QString(digits.at(i))});
+            }
+        }
+        replay(ed, keys);
+    }
+
+    void feedViKey(QPlainTextEdit *ed, const Key &key) {
+        const QString name = keyName(key);
+        if (name.isEmpty()) return;
+        if (m_prefix == "r" || m_prefix == "\"" || m_prefix == "q" || m_prefix == "@"
+            || (m_prefix.size() == 1 && QString("fFtT").contains(m_prefix))
+            || (!m_operator.isEmpty() && (m_prefix == "i" || m_prefix == "a"))) {
+            // Character arguments come from the typed key, not its name:
+            // <CR> is a line break for r and invalid everywhere else.
+            QChar arg;
+            if (key.key == Qt::Key_Return || key.key == Qt::Key_Enter) {
+                if (m_prefix == "r") arg = QLatin1Char('\n');
+            } else if (!(key.modifiers & Qt::ControlModifier) && key.text.size() == 1 && key.text.at(0).isPrint()) {
+                arg = key.text.at(0);
+            }
+            if (arg.isNull()) {
+                resetPending();
+                m_cbVimKey("");
+                return;
+            }
+            m_changeKeys.append(key);
+            m_sequence += name;
+            feedToken(ed, m_prefix + arg);
             return;
         }
-        if (e->key() == Qt::Key_A) {
-            INS();
-            cursor.movePosition(QTextCursor::Right);
-            ed->setTextCursor(cursor);
-            m_cbVimKey("a");
+        m_changeKeys.append(key);
+        m_sequence += name;
+        feedToken(ed, m_prefix + name);
+    }
+
+    void feedToken(QPlainTextEdit *ed, const QString &token) {
+        QTextDocument *doc = ed->document();
+        const QString prefix = m_prefix;
+        m_prefix.clear();
+
+        if (prefix == "\"") {
+            m_register = token.back();
             return;
         }
-        if (e->key() == Qt::Key_Colon) {
-            CMD();
+        if (prefix == "q") {
+            const QChar name = token.back();
+            resetPending();
+            if (!name.isLetterOrNumber()) return;
+            m_recording = name.toLower();
+            m_recordedKeys = name.isUpper() ? macros().value(m_recording) : QList<Key>();
+            m_cbVimKey(QString("recording @%1").arg(m_recording));
             return;
         }
-        if (e->key() == Qt::Key_H) {
-            cursor.movePosition(QTextCursor::Left);
-            ed->setTextCursor(cursor);
-            m_cbVimKey("h");
+        if (prefix == "@") {
+            const QChar name = token.back() == QLatin1Char('@') ? m_lastMacro : token.back().toLower();
+            const int count = qMax(1, m_count);
+            resetPending();
+            if (!name.isNull()) playMacro(ed, name, count);
             return;
         }
-        if (e->key() == Qt::Key_J) {
-            cursor.movePosition(QTextCursor::Down);
-            ed->setTextCursor(cursor);
-            m_cbVimKey("j");
+        if (prefix == "r") {
+            const int count = m_count;
+            QTextCursor block = ed->textCursor();
+            block.beginEditBlock();
+            commands().value("r").run(*this, ed, count, token.back());
+            block.endEditBlock();
+            finishCommand(true, false);
             return;
         }
-        if (e->key() == Qt::Key_K) {
-            cursor.movePosition(QTextCursor::Up);
-            ed->setTextCursor(cursor);
-            m_cbVimKey("k");
+
+        const bool charMotion = prefix.size() == 1 && QString("fFtT").contains(prefix);
+        const bool objectPending = !m_operator.isEmpty() && (prefix == "i" || prefix == "a");
+        QChar arg;
+        QString op = charMotion ? prefix : token;
+        if (charMotion) {
+            arg = token.back();
+            lastFind() = prefix.at(0);
+            lastFindChar() = arg;
+        }
+
+        if (!charMotion && !objectPending && token.size() == 1 && token.at(0).isDigit()
+            && (token != "0" || (m_operator.isEmpty() ? m_count : m_opCount) > 0)) {
+            int &count = m_operator.isEmpty() ? m_count : m_opCount;
+            count = count * 10 + token.at(0).digitValue();
             return;
         }
-        if (e->key() == Qt::Key_L) {
-            cursor.movePosition(QTextCursor::Right);
-            ed->setTextCursor(cursor);
-            m_cbVimKey("l");
+
+        if (token == "q" && prefix.isEmpty() && m_operator.isEmpty() && !m_recording.isNull()) {
+            if (!m_recordedKeys.isEmpty()) m_recordedKeys.removeLast();
+            macros().insert(m_recording, m_recordedKeys);
+            m_cbVimKey(QString("recorded @%1").arg(m_recording));
+            m_recording = QChar();
+            m_recordedKeys.clear();
+            resetPending();
             return;
         }
-        if (e->key() == Qt::Key_W && !(e->modifiers() & Qt::ControlModifier)) {
-            cursor.movePosition(QTextCursor::NextWord);
-            ed->setTextCursor(cursor);
-            m_cbVimKey("w");
+
+        if (!charMotion && !objectPending) {
+            if (token == "\"" || token == "g" || token == "r" || token == "q" || token == "@" || (token.size() == 1 && QString("fFtT").contains(token))
+                || (!m_operator.isEmpty() && (token == "i" || token == "a"))) {
+                m_prefix = token;
+                return;
+            }
+        }
+
+        const int count = m_operator.isEmpty() ? m_count
+                        : (m_count > 0 || m_opCount > 0) ? qMax(1, m_count) * qMax(1, m_opCount) : 0;
+        QTextCursor cursor = ed->textCursor();
+        const int from = cursor.position();
+
+        if (!m_operator.isEmpty()) {
+            int start = from, end = from;
+            bool linewise = false;
+            bool ok = false;
+            if (objectPending) {
+                ok = textObject(doc, from, prefix.at(0), token.back(), start, end);
+            } else if (op == m_operator || (m_operator.size() == 2 && op == m_operator.right(1))) {
+                const QTextBlock b = doc->findBlock(from);
+                start = b.position();
+                end = doc->findBlockByNumber(qMin(doc->blockCount() - 1, b.blockNumber() + qMax(1, count) - 1)).position();
+                linewise = ok = true;
+            } else if (motions().contains(op)) {
+                // cw/cW on a word behaves like ce/cE, as in vi.
+                QString name = op;
+                const bool big = op == "W";
+                const int cls = charClass(doc->characterAt(from), big);
+                if (m_operator == "c" && (op == "w" || op == "W") && cls != 0) {
+                    name = big ? "E" : "e";
+                }
+                const Motion motion = motions().value(name);
+                if (name != op && count <= 1 && charClass(doc->characterAt(from + 1), big) != cls) {
+                    ok = true;
+                } else {
+                    ok = motion.move(doc, end, count, arg);
+                }
+                linewise = motion.kind == Linewise;
+                if (end < start) std::swap(start, end);
+                if (ok && motion.kind == Inclusive) end = qMin(end + 1, lastPos(doc));
+                if (ok && (name == "w" || name == "W")) {
+                    const QTextBlock endBlock = doc->findBlock(end);
+                    if (end > start && endBlock.position() == end && doc->findBlock(start) != endBlock) {
+                        end = qMax(start, end - 1);
+                    }
+                }
+            }
+            if (!ok) {
+                resetPending();
+                return;
+            }
+            QTextCursor block(doc);
+            block.beginEditBlock();
+            const bool insert = applyOperator(ed, start, end, linewise);
+            block.endEditBlock();
+            finishCommand(m_operator != "y", insert);
             return;
         }
-        if (e->key() == Qt::Key_B) {
-            cursor.movePosition(QTextCursor::PreviousWord);
-            ed->setTextCursor(cursor);
-            m_cbVimKey("b");
+
+        if (aliases().contains(token)) {
+            const QString expansion = aliases().value(token);
+            for (const QChar &ch : expansion) {
+                feedToken(ed, m_prefix + ch);
+            }
             return;
         }
-        if (e->key() == Qt::Key_X) {
-            cursor.deleteChar();
-            m_cbVimKey("x");
+
+        if (operators().contains(token)) {
+            m_operator = token;
             return;
         }
-        if (e->key() == Qt::Key_D) {
-            if (e->modifiers() & Qt::ShiftModifier) {
-                cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
-                cursor.removeSelectedText();
-                m_cbVimKey("D");
-            } else {
-                cursor.select(QTextCursor::LineUnderCursor);
-                cursor.removeSelectedText();
-                m_cbVimKey("dd");
+
+        if (motions().contains(op)) {
+            int pos = from;
+            if (motions().value(op).move(doc, pos, count, arg)) {
+                cursor.setPosition(pos);
+                ed->setTextCursor(cursor);
             }
+            finishCommand(false, false);
             return;
         }
-        if (e->key() == Qt::Key_Y) {
-            cursor.select(QTextCursor::LineUnderCursor);
-            QApplication::clipboard()->setText(cursor.selectedText());
-            cursor.clearSelection();
-            m_cbVimKey("yy");
+
+        if (token == ".") {
+            const int repeat = m_count;
+            resetPending();
+            QTextCursor block(doc);
+            block.beginEditBlock();
+            repeatLastChange(ed, repeat);
+            block.endEditBlock();
+            m_cbVimKey(".");
             return;
         }
-        if (e->key() == Qt::Key_O) {
-            cursor.movePosition(QTextCursor::EndOfLine);
-            ed->setTextCursor(cursor);
-            ed->insertPlainText("\n");
-            INS();
-            m_cbVimKey("o");
+
+        if (commands().contains(token)) {
+            const Command command = commands().value(token);
+            QTextCursor block(doc);
+            if (command.change) block.beginEditBlock();
+            command.run(*this, ed, count, arg);
+            if (command.change) block.endEditBlock();
+            finishCommand(command.change, command.enterInsert);
             return;
         }
-        if (e->key() == Qt::Key_W && (e->modifiers() & Qt::ControlModifier)) {
-            m_cbSaveReq();
-            m_cbVimKey("<C-w>");
+
+        resetPending();
+    }
+
+    // Replays a recorded macro count times as one edit block with repaints
+    // held until the end. Editor signals still flow, so :w and :q inside a
+    // macro work; the frame scheduler coalesces the cursor-driven UI work.
+    void playMacro(QPlainTextEdit *ed, QChar name, int count) {
+        const QList<Key> keys = macros().value(name);
+        if (keys.isEmpty() || m_macroDepth >= MAX_MACRO_DEPTH) return;
+        m_lastMacro = name;
+
+        QList<Key> all;
+        all.reserve(keys.size() * count);
+        for (int n = 0; n < count; ++n) all += keys;
+
+        if (m_macroDepth > 0) {
+            ++m_macroDepth;
+            replay(ed, all);
+            --m_macroDepth;
             return;
         }
+
+        // Highlighters stay attached: the single edit block below reaches them
+        // as one contentsChange covering only the edited span.
+        QTextDocument *doc = ed->document();
+        ed->setUpdatesEnabled(false);
+        QTextCursor block(doc);
+        block.beginEditBlock();
+        ++m_macroDepth;
+        replay(ed, all);
+        --m_macroDepth;
+        block.endEditBlock();
+        ed->setUpdatesEnabled(true);
+
+        ed->ensureCursorVisible();
+        ed->viewport()->update();
+        m_cbVimKey(QString("@%1").arg(name));
+    }
+
+    void handleViKey(QPlainTextEdit *ed, QKeyEvent *e) {
+        feedViKey(ed, {e->key(), e->modifiers(), e->text()});
+    }
+
+    // Ex command line: [range]command[!] [args]. Line-oriented commands read
+    // a snapshot of the affected lines, compute the result in memory and
+    // write back only the span that changed, inside one edit block.
+    struct ExRange {
+        int  first;
+        int  last;
+        bool given;
+    };
+
+    using ExFn = bool (*)(Mode &mode, QPlainTextEdit *ed, const ExRange &range, bool bang, const QString &args);
+
+    struct ExCommand {
+        ExFn run;
+        bool wholeFileByDefault;
+    };
+
+    QString m_exMessage;
+
+    static QString &lastExPattern() {
+        static QString pattern;
+        return pattern;
+    }
+
+    static const QHash<QString, ExCommand> &exCommands() {
+        static const ExCommand write  = {[](Mode &m, QPlainTextEdit *, const ExRange &, bool, const QString &) {
+            m.m_cbSaveReq(); return true; }, false};
+        static const ExCommand quit   = {[](Mode &m, QPlainTextEdit *, const ExRange &, bool bang, const QString &) {
+            m.m_cbQuitReq(bang); return true; }, false};
+        static const ExCommand exit   = {[](Mode &m, QPlainTextEdit *, const ExRange &, bool bang, const QString &) {
+            m.m_cbSaveReq(); m.m_cbQuitReq(bang); return true; }, false};
+        static const ExCommand remove = {[](Mode &m, QPlainTextEdit *ed, const ExRange &r, bool, const QString &) {
+            const QStringList lines = linesOf(ed->document(), r.first, r.last);
+            m.storeRegister(lines.join('\n') + "\n", true, false);
+            writeLines(ed, r.first, lines, {});
+            m.m_exMessage = QString("%1 fewer lines").arg(lines.size());
+            return true; }, false};
+        static const ExCommand yank   = {[](Mode &m, QPlainTextEdit *ed, const ExRange &r, bool, const QString &) {
+            const QStringList lines = linesOf(ed->document(), r.first, r.last);
+            m.storeRegister(lines.join('\n') + "\n", true, true);
+            m.m_exMessage = QString("%1 lines yanked").arg(lines.size());
+            return true; }, false};
+        static const ExCommand subst  = {[](Mode &m, QPlainTextEdit *ed, const ExRange &r, bool, const QString &args) {
+            Substitution sub;
+            if (!parseSubstitution(args, sub)) return false;
+            const QStringList before = linesOf(ed->document(), r.first, r.last);
+            QStringList after = before;
+            int count = 0, lines = 0, lastLine = -1;
+            for (int i = 0; i < after.size(); ++i) {
+                const int n = sub.apply(after[i]);
+                if (n > 0) {
+                    count += n;
+                    ++lines;
+                    lastLine = r.first + i;
+                }
+            }
+            if (count == 0) return false;
+            writeLines(ed, r.first, before, after);
+            gotoLine(ed, lastLine);
+            m.m_exMessage = QString("%1 substitutions on %2 lines").arg(count).arg(lines);
+            return true; }, false};
+        static const ExCommand global = {[](Mode &m, QPlainTextEdit *ed, const ExRange &r, bool bang, const QString &args) {
+            return m.runGlobal(ed, r, bang, args); }, true};
+        static const ExCommand invert = {[](Mode &m, QPlainTextEdit *ed, const ExRange &r, bool, const QString &args) {
+            return m.runGlobal(ed, r, true, args); }, true};
+        static const ExCommand sort   = {[](Mode &, QPlainTextEdit *ed, const ExRange &r, bool bang, const QString &args) {
+            const QStringList before = linesOf(ed->document(), r.first, r.last);
+            QStringList after = before;
+            const bool numeric = args.contains('n');
+            const Qt::CaseSensitivity cs = args.contains('i') ? Qt::CaseInsensitive : Qt::CaseSensitive;
+            static const QRegularExpression number("-?\\d+");
+            std::stable_sort(after.begin(), after.end(), [&](const QString &a, const QString &b) {
+                if (numeric) {
+                    const QRegularExpressionMatch ma = number.match(a), mb = number.match(b);
+                    return (ma.hasMatch() ? ma.captured().toLongLong() : LLONG_MIN)
+                         < (mb.hasMatch() ? mb.captured().toLongLong() : LLONG_MIN);
+                }
+                return a.compare(b, cs) < 0;
+            });
+            if (bang) std::reverse(after.begin(), after.end());
+            if (args.contains('u')) {
+                after.erase(std::unique(after.begin(), after.end(), [cs](const QString &a, const QString &b) {
+                    return a.compare(b, cs) == 0; }), after.end());
+            }
+            writeLines(ed, r.first, before, after);
+            return true; }, true};
+
+        static const QHash<QString, ExCommand> table = {
+            {"w", write}, {"write", write},
+            {"q", quit}, {"quit", quit},
+            {"wq", exit}, {"x", exit}, {"exit", exit},
+            {"d", remove}, {"delete", remove},
+            {"y", yank}, {"yank", yank},
+            {"s", subst}, {"substitute", subst},
+            {"g", global}, {"global", global},
+            {"v", invert}, {"vglobal", invert},
+            {"sor", sort}, {"sort", sort},
+        };
+        return table;
+    }
+
+    struct Substitution {
+        QRegularExpression regex;
+        QString            replacement;
+        bool               global = false;
+
+        // Rewrites line in place and returns the number of replacements.
+        int apply(QString &line) const {
+            QRegularExpressionMatchIterator it = regex.globalMatch(line);
+            if (!it.hasNext()) return 0;
+
+            QString out;
+            out.reserve(line.size());
+            qsizetype tail = 0;
+            int count = 0;
+            while (it.hasNext()) {
+                const QRegularExpressionMatch match = it.next();
+                out += QStringView(line).mid(tail, match.capturedStart() - tail);
+                out += expand(match);
+                tail = match.capturedEnd();
+                ++count;
+                if (!global) break;
+            }
+            out += QStringView(line).mid(tail);
+            line = out;
+            return count;
+        }
+
+        QString expand(const QRegularExpressionMatch &match) const {
+            QString out;
+            for (qsizetype i = 0; i < replacement.size(); ++i) {
+                const QChar c = replacement.at(i);
+                if (c == QLatin1Char('&')) {
+                    out += match.captured(0);
+                } else if (c == QLatin1Char('\\') && i + 1 < replacement.size()) {
+                    const QChar next = replacement.at(++i);
+                    if (next.isDigit()) out += match.captured(next.digitValue());
+                    else if (next == QLatin1Char('n') || next == QLatin1Char('r')) out += QLatin1Char('\n');
+                    else if (next == QLatin1Char('t')) out += QLatin1Char('\t');
+                    else out += next;
+                } else {
+                    out += c;
+                }
+            }
+            return out;
+        }
+    };
+
+    // Translates a vi (magic) pattern to PCRE: \( \) \| \+ \? \= \{ become
+    // operators, their bare forms become literals, and \< \> become \b.
+    // A leading \v means the rest is already "very magic" (PCRE-like).
+    static QString viPatternToRegex(const QString &pattern) {
+        if (pattern.startsWith("\\v")) return pattern.mid(2);
+        static const QString operatorsAfterSlash = "()|+?={}";
+        QString out;
+        for (qsizetype i = 0; i < pattern.size(); ++i) {
+            const QChar c = pattern.at(i);
+            if (c == QLatin1Char('\\') && i + 1 < pattern.size()) {
+                const QChar next = pattern.at(++i);
+                if (next == QLatin1Char('<') || next == QLatin1Char('>')) out += "\\b";
+                else if (next == QLatin1Char('=')) out += QLatin1Char('?');
+                else if (operatorsAfterSlash.contains(next)) out += next;
+                else out += QLatin1Char('\\') + QString(next);
+            } else if (operatorsAfterSlash.contains(c)) {
+                out += QLatin1Char('\\') + QString(c);
+            } else {
+                out += c;
+            }
+        }
+        return out;
+    }
+
+    // Splits {delim}pattern{delim}replacement{delim}flags.
+    static bool parseSubstitution(const QString &args, Substitution &sub) {
+        const QString text = args.trimmed();
+        if (text.isEmpty() || text.at(0).isLetterOrNumber() || text.at(0).isSpace()) return false;
+        const QChar delim = text.at(0);
+
+        QStringList parts{QString()};
+        for (qsizetype i = 1; i < text.size(); ++i) {
+            const QChar c = text.at(i);
+            if (c == QLatin1Char('\\') && i + 1 < text.size() && text.at(i + 1) == delim) {
+                parts.last() += delim;
+                ++i;
+            } else if (c == delim && parts.size() < 3) {
+                parts.append(QString());
+            } else {
+                parts.last() += c;
+            }
+        }
+        while (parts.size() < 3) parts.append(QString());
+
+        QString pattern = parts.at(0);
+        if (pattern.isEmpty()) pattern = lastExPattern();
+        if (pattern.isEmpty()) return false;
+        lastExPattern() = pattern;
+
+        const QString flags = parts.at(2).trimmed();
+        QRegularExpression::PatternOptions options = QRegularExpression::NoPatternOption;
+        if (flags.contains('i')) options |= QRegularExpression::CaseInsensitiveOption;
+        sub.regex = QRegularExpression(viPatternToRegex(pattern), options);
+        sub.replacement = parts.at(1);
+        sub.global = flags.contains('g');
+        return sub.regex.isValid();
+    }
+
+    bool runGlobal(QPlainTextEdit *ed, const ExRange &range, bool invert, const QString &args) {
+        const QString text = args.trimmed();
+        if (text.isEmpty()) return false;
+        const QChar delim = text.at(0);
+        const qsizetype close = text.indexOf(delim, 1);
+        QString pattern = text.mid(1, close < 0 ? -1 : close - 1);
+        const QString command = close < 0 ? QString("p") : text.mid(close + 1).trimmed();
+        if (pattern.isEmpty()) pattern = lastExPattern();
+        lastExPattern() = pattern;
+        const QRegularExpression regex(viPatternToRegex(pattern));
+        if (!regex.isValid()) return false;
+
+        Substitution sub;
+        const bool remove = command == "d" || command == "delete";
+        const bool substitute = command.startsWith('s') && parseSubstitution(command.mid(command.startsWith("substitute") ? 10 : 1), sub);
+        if (!remove && !substitute) return false;
+
+        const QStringList before = linesOf(ed->document(), range.first, range.last);
+        QStringList after;
+        after.reserve(before.size());
+        QStringList removed;
+        int hits = 0;
+        for (const QString &line : before) {
+            if (regex.match(line).hasMatch() == invert) {
+                after.append(line);
+                continue;
+            }
+            ++hits;
+            if (remove) {
+                removed.append(line);
+            } else {
+                QString changed = line;
+                sub.apply(changed);
+                after.append(changed);
+            }
+        }
+        if (hits == 0) return false;
+
+        if (!removed.isEmpty()) storeRegister(removed.join('\n') + "\n", true, false);
+        writeLines(ed, range.first, before, after);
+        m_exMessage = remove ? QString("%1 fewer lines").arg(hits) : QString("%1 lines changed").arg(hits);
+        return true;
+    }
+
+    static QStringList linesOf(QTextDocument *doc, int first, int last) {
+        QStringList lines;
+        lines.reserve(last - first + 1);
+        for (QTextBlock b = doc->findBlockByNumber(first); b.isValid() && b.blockNumber() <= last; b = b.next()) {
+            lines.append(b.text());
+        }
+        return lines;
+    }
+
+    // Replaces the lines starting at first (currently `before`) with `after`,
+    // touching only the span between the first and last differing line.
+    static void writeLines(QPlainTextEdit *ed, int first, const QStringList &before, const QStringList &after) {
+        qsizetype head = 0;
+        while (head < before.size() && head < after.size() && before.at(head) == after.at(head)) ++head;
+        qsizetype tail = 0;
+        while (tail < before.size() - head && tail < after.size() - head
+               && before.at(before.size() - 1 - tail) == after.at(after.size() - 1 - tail)) ++tail;
+        if (head == before.size() && head == after.size()) return;
+
+        QTextDocument *doc = ed->document();
+        const int from = first + head;
+        const int to = first + before.size() - 1 - tail;
+        const QStringList replacement = after.mid(head, after.size() - head - tail);
+
+        QTextCursor c(doc);
+        if (from > to) {
+            const QTextBlock at = doc->findBlockByNumber(from);
+            if (at.isValid()) {
+                c.setPosition(at.position());
+                c.insertText(replacement.join('\n') + "\n");
+            } else {
+                c.movePosition(QTextCursor::End);
+                c.insertText("\n" + replacement.join('\n'));
+            }
+        } else {
+            const QTextBlock a = doc->findBlockByNumber(from);
+            const QTextBlock b = doc->findBlockByNumber(to);
+            if (!replacement.isEmpty()) {
+                c.setPosition(a.position());
+                c.setPosition(b.position() + b.length() - 1, QTextCursor::KeepAnchor);
+                c.insertText(replacement.join('\n'));
+            } else if (b.next().isValid()) {
+                c.setPosition(a.position());
+                c.setPosition(b.next().position(), QTextCursor::KeepAnchor);
+                c.removeSelectedText();
+            } else {
+                c.setPosition(a.previous().isValid() ? a.position() - 1 : a.position());
+                c.setPosition(b.position() + b.length() - 1, QTextCursor::KeepAnchor);
+                c.removeSelectedText();
+            }
+        }
+        gotoLine(ed, qMin(from, doc->blockCount() - 1));
+    }
+
+    static void gotoLine(QPlainTextEdit *ed, int line) {
+        QTextCursor c = ed->textCursor();
+        c.setPosition(firstNonBlank(ed->document()->findBlockByNumber(qBound(0, line, ed->document()->blockCount() - 1))));
+        ed->setTextCursor(c);
+    }
+
+    static bool parseExAddress(const QString &cmd, qsizetype &i, int current, int lastLine, int &line) {
+        bool found = false;
+        if (i < cmd.size() && cmd.at(i).isDigit()) {
+            qsizetype start = i;
+            while (i < cmd.size() && cmd.at(i).isDigit()) ++i;
+            line = cmd.mid(start, i - start).toInt() - 1;
+            found = true;
+        } else if (i < cmd.size() && cmd.at(i) == QLatin1Char('.')) {
+            line = current;
+            ++i;
+            found = true;
+        } else if (i < cmd.size() && cmd.at(i) == QLatin1Char('$')) {
+            line = lastLine;
+            ++i;
+            found = true;
+        }
+        while (i < cmd.size() && (cmd.at(i) == QLatin1Char('+') || cmd.at(i) == QLatin1Char('-'))) {
+            const int sign = cmd.at(i) == QLatin1Char('+') ? 1 : -1;
+            qsizetype start = ++i;
+            while (i < cmd.size() && cmd.at(i).isDigit()) ++i;
+            const int offset = i > start ? cmd.mid(start, i - start).toInt() : 1;
+            if (!found) line = current;
+            line += sign * offset;
+            found = true;
+        }
+        return found;
+    }
+
+    bool executeEx(QPlainTextEdit *ed, const QString &cmd) {
+        QTextDocument *doc = ed->document();
+        const int current = ed->textCursor().blockNumber();
+        const int lastLine = doc->blockCount() - 1;
+        m_exMessage.clear();
+
+        qsizetype i = 0;
+        ExRange range{current, current, false};
+        if (i < cmd.size() && cmd.at(i) == QLatin1Char('%')) {
+            range = {0, lastLine, true};
+            ++i;
+        } else if (parseExAddress(cmd, i, current, lastLine, range.first)) {
+            range.last = range.first;
+            range.given = true;
+            if (i < cmd.size() && (cmd.at(i) == QLatin1Char(',') || cmd.at(i) == QLatin1Char(';'))) {
+                ++i;
+                if (!parseExAddress(cmd, i, current, lastLine, range.last)) return false;
+            }
+        }
+        if (range.first > range.last) std::swap(range.first, range.last);
+        range.first = qBound(0, range.first, lastLine);
+        range.last = qBound(0, range.last, lastLine);
+
+        while (i < cmd.size() && cmd.at(i).isSpace()) ++i;
+        const qsizetype nameStart = i;
+        while (i < cmd.size() && cmd.at(i).isLetter()) ++i;
+        const QString name = cmd.mid(nameStart, i - nameStart);
+        const bool bang = i < cmd.size() && cmd.at(i) == QLatin1Char('!');
+        if (bang) ++i;
+        const QString args = cmd.mid(i);
+
+        if (name.isEmpty()) {
+            if (!range.given || !args.trimmed().isEmpty()) return false;
+            gotoLine(ed, range.last);
+            return true;
+        }
+
+        const auto it = exCommands().constFind(name);
+        if (it == exCommands().constEnd()) return false;
+        if (!range.given && it->wholeFileByDefault) range = {0, lastLine, false};
+        return it->run(*this, ed, range, bang, args);
     }
 
-    void handleCmdKey(QKeyEvent *e) {
+    void handleCmdKey(QPlainTextEdit *ed, QKeyEvent *e) {
         if (e->key() == Qt::Key_Return || e->key() == Qt::Key_Enter) {
             QString cmd = m_cmdLine.mid(1).trimmed();
-            bool success = false;
-            if (cmd == "w" || cmd == "write") {
-                m_cbSaveReq();
-                success = true;
-            } else if (cmd == "q" || cmd == "quit") {
-                success = true;
-            } else if (cmd == "wq") {
-                m_cbSaveReq();
-                success = true;
-            } else if (cmd == "q!") {
-                success = true;
-            }
-            m_cbCmdExecuted(cmd, success);
+            QTextCursor block(ed->document());
+            block.beginEditBlock();
+            const bool success = executeEx(ed, cmd);
+            block.endEditBlock();
+            m_cbCmdExecuted(m_exMessage.isEmpty() ? cmd : cmd + " (" + m_exMessage + ")", success);
             m_cmdLine.clear();
             Vi();
             m_cbCmdChanged("");
@@ -351,6 +1684,372 @@ public:
     }
 };
 
+// Persistent piece tree: a treap of text pieces where every node carries the
+// length and newline count of its subtree, so position and line lookups,
+// splits and edits are O(log pieces). Nodes are immutable and shared, which
+// makes copying a table (for snapshots) O(1).
+class PieceTable {
+public:
+    // Backing text for pieces. Loaded and large inserted text is referenced
+    // as-is; small edits append into fixed-capacity add chunks that never
+    // reallocate, so views held by snapshots stay valid while typing continues.
+    struct Storage {
+        QString          text;
+        QList<qsizetype> breaks;
+    };
+
+    struct Piece {
+        std::shared_ptr<const Storage> storage;
+        qsizetype offset   = 0;
+        qsizetype length   = 0;
+        qsizetype newlines = 0;
+
+        QStringView view() const { return QStringView(storage->text.constData() + offset, length); }
+    };
+
+    PieceTable() = default;
+    PieceTable(const PieceTable &other)
+        : m_root(other.m_root), m_seed(other.m_seed) {}
+    PieceTable &operator=(const PieceTable &other) {
+        m_root = other.m_root;
+        m_seed = other.m_seed;
+        m_add.reset();
+        return *this;
+    }
+
+    void reset(const QString &text) {
+        m_add.reset();
+        m_root.reset();
+        if (!text.isEmpty())
+            m_root = makeNode(storedPiece(text), nextPriority(), nullptr, nullptr);
+    }
+
+    void replace(qsizetype pos, qsizetype removed, const QString &inserted) {
+        pos     = qBound<qsizetype>(0, pos, length());
+        removed = qBound<qsizetype>(0, removed, length() - pos);
+        auto [left, rest]  = split(m_root, pos);
+        auto [gone, right] = split(rest, removed);
+        Q_UNUSED(gone);
+        if (!inserted.isEmpty() && !appendToLast(left, inserted))
+            left = merge(left, makeNode(pieceFor(inserted), nextPriority(), nullptr, nullptr));
+        m_root = merge(left, right);
+    }
+
+    qsizetype length() const { return m_root ? m_root->length : 0; }
+    qsizetype lineCount() const { return (m_root ? m_root->newlines : 0) + 1; }
+
+    template<typename Fn>
+    void forEachChunk(Fn &&fn) const { visit(m_root.get(), fn); }
+
+    QString text(qsizetype pos, qsizetype len) const {
+        pos = qBound<qsizetype>(0, pos, length());
+        len = qBound<qsizetype>(0, len, length() - pos);
+        QString out;
+        out.reserve(len);
+        visitRange(m_root.get(), pos, pos + len, [&out](QStringView v) { out.append(v); });
+        return out;
+    }
+
+    // Compares a range against text without materializing it
+    bool matches(qsizetype pos, QStringView text) const {
+        if (pos < 0 || pos + text.size() > length()) return false;
+        bool same = true;
+        qsizetype at = 0;
+        visitRange(m_root.get(), pos, pos + text.size(), [&](QStringView v) {
+            if (same && v != text.mid(at, v.size())) same = false;
+            at += v.size();
+        });
+        return same;
+    }
+
+    QString toString() const { return text(0, length()); }
+
+    PieceTable frozen() const { return *this; }
+
+    qsizetype lineStart(qsizetype line) const {
+        if (line <= 0) return 0;
+        if (line >= lineCount()) return length();
+        const Node *n = m_root.get();
+        qsizetype base = 0;
+        while (n) {
+            const qsizetype leftLines = n->left ? n->left->newlines : 0;
+            const qsizetype leftLen   = n->left ? n->left->length : 0;
+            if (line <= leftLines) {
+                n = n->left.get();
+                continue;
+            }
+            line -= leftLines;
+            if (line <= n->piece.newlines)
+                return base + leftLen + nthNewline(n->piece, line) + 1;
+            line -= n->piece.newlines;
+            base += leftLen + n->piece.length;
+            n = n->right.get();
+        }
+        return length();
+    }
+
+    QString lineAt(qsizetype line) const {
+        qsizetype start = lineStart(line);
+        qsizetype end   = line + 1 < lineCount() ? lineStart(line + 1) - 1 : length();
+        return text(start, end - start);
+    }
+
+private:
+    static constexpr qsizetype COALESCE_SIZE = 4096;
+    static constexpr qsizetype ADD_CHUNK     = 16384;
+    static constexpr qsizetype INDEX_SIZE    = 65536;
+
+    struct Node;
+    using NodePtr = std::shared_ptr<const Node>;
+    struct Node {
+        Piece     piece;
+        quint32   priority = 0;
+        NodePtr   left;
+        NodePtr   right;
+        qsizetype length   = 0;
+        qsizetype newlines = 0;
+    };
+
+    NodePtr                  m_root;
+    std::shared_ptr<Storage> m_add;
+    quint32                  m_seed = 0x9e3779b9u;
+
+    quint32 nextPriority() {
+        m_seed ^= m_seed << 13;
+        m_seed ^= m_seed >> 17;
+        m_seed ^= m_seed << 5;
+        return m_seed;
+    }
+
+    static NodePtr makeNode(const Piece &piece, quint32 priority, NodePtr left, NodePtr right) {
+        auto n = std::make_shared<Node>();
+        n->piece    = piece;
+        n->priority = priority;
+        n->length   = piece.length + (left ? left->length : 0) + (right ? right->length : 0);
+        n->newlines = piece.newlines + (left ? left->newlines : 0) + (right ? right->newlines : 0);
+        n->left     = std::move(left);
+        n->right    = std::move(right);
+        return n;
+    }
+
+    static Piece storedPiece(const QString &text) {
+        auto storage = std::make_shared<Storage>();
+        storage->text = text;
+        if (text.size() >= INDEX_SIZE) {
+            for (qsizetype i = text.indexOf(QLatin1Char('\n')); i != -1; i = text.indexOf(QLatin1Char('\n'), i + 1))
+                storage->breaks.append(i);
+        }
+        Piece p;
+        p.storage  = storage;
+        p.length   = text.size();
+        p.newlines = text.size() >= INDEX_SIZE ? storage->breaks.size() : text.count(QLatin1Char('\n'));
+        return p;
+    }
+
+    Piece pieceFor(const QString &text) {
+        if (text.size() > COALESCE_SIZE) return storedPiece(text);
+        if (!m_add || m_add->text.size() + text.size() > ADD_CHUNK) {
+            m_add = std::make_shared<Storage>();
+            m_add->text.reserve(ADD_CHUNK);
+        }
+        Piece p;
+        p.storage  = m_add;
+        p.offset   = m_add->text.size();
+        p.length   = text.size();
+        p.newlines = text.count(QLatin1Char('\n'));
+        m_add->text.append(text.constData(), text.size());
+        return p;
+    }
+
+    // Typing right after the previous insertion grows that piece instead of adding one
+    bool appendToLast(NodePtr &tree, const QString &text) {
+        if (!tree || !m_add || m_add->text.size() + text.size() > ADD_CHUNK) return false;
+        const Node *last = tree.get();
+        while (last->right) last = last->right.get();
+        const Piece &p = last->piece;
+        if (p.storage != m_add || p.offset + p.length != m_add->text.size()
+            || p.length + text.size() > COALESCE_SIZE)
+            return false;
+        m_add->text.append(text.constData(), text.size());
+        tree = growLast(tree, text.size(), text.count(QLatin1Char('\n')));
+        return true;
+    }
+
+    static NodePtr growLast(const NodePtr &n, qsizetype length, qsizetype newlines) {
+        if (n->right)
+            return makeNode(n->piece, n->priority, n->left, growLast(n->right, length, newlines));
+        Piece p = n->piece;
+        p.length   += length;
+        p.newlines += newlines;
+        return makeNode(p, n->priority, n->left, nullptr);
+    }
+
+    static qsizetype newlinesIn(const Piece &p, qsizetype from, qsizetype len) {
+        const QList<qsizetype> &breaks = p.storage->breaks;
+        if (!breaks.isEmpty()) {
+            auto lo = std::lower_bound(breaks.cbegin(), breaks.cend(), p.offset + from);
+            auto hi = std::lower_bound(lo, breaks.cend(), p.offset + from + len);
+            return hi - lo;
+        }
+        return p.view().mid(from, len).count(QLatin1Char('\n'));
+    }
+
+    static qsizetype nthNewline(const Piece &p, qsizetype nth) {
+        const QList<qsizetype> &breaks = p.storage->breaks;
+        if (!breaks.isEmpty()) {
+            auto first = std::lower_bound(breaks.cbegin(), breaks.cend(), p.offset);
+            return *(first + (nth - 1)) - p.offset;
+        }
+        QStringView v = p.view();
+        qsizetype at = -1;
+        for (qsizetype k = 0; k < nth; ++k)
+            at = v.indexOf(QLatin1Char('\n'), at + 1);
+        return at;
+    }
+
+    static Piece slice(const Piece &p, qsizetype from, qsizetype len) {
+        Piece s    = p;
+        s.offset   = p.offset + from;
+        s.length   = len;
+        s.newlines = newlinesIn(p, from, len);
+        return s;
+    }
+
+    // Splits into [0, pos) and [pos, end); a piece straddling pos is sliced
+    static std::pair<NodePtr, NodePtr> split(const NodePtr &n, qsizetype pos) {
+        if (!n) return {};
+        const qsizetype leftLen = n->left ? n->left->length : 0;
+        if (pos <= leftLen) {
+            if (pos == 0 && !n->left) return {nullptr, n};
+            auto [a, b] = split(n->left, pos);
+            return {a, makeNode(n->piece, n->priority, b, n->right)};
+        }
+        const qsizetype local = pos - leftLen;
+        if (local >= n->piece.length) {
+            if (local == n->piece.length && !n->right) return {n, nullptr};
+            auto [a, b] = split(n->right, local - n->piece.length);
+            return {makeNode(n->piece, n->priority, n->left, a), b};
+        }
+        const Piece head = slice(n->piece, 0, local);
+        Piece tail = n->piece;
+        tail.offset   += local;
+        tail.length   -= local;
+        tail.newlines -= head.newlines;
+        return {makeNode(head, n->priority, n->left, nullptr),
+                makeNode(tail, n->priority, nullptr, n->right)};
+    }
+
+    static NodePtr merge(const NodePtr &a, const NodePtr &b) {
+        if (!a) return b;
+        if (!b) return a;
+        if (a->priority > b->priority)
+            return makeNode(a->piece, a->priority, a->left, merge(a->right, b));
+        return makeNode(b->piece, b->priority, merge(a, b->left), b->right);
+    }
+
+    template<typename Fn>
+    static void visit(const Node *n, Fn &fn) {
+        if (!n) return;
+        visit(n->left.get(), fn);
+        fn(n->piece.view());
+        visit(n->right.get(), fn);
+    }
+
+    // Visits the chunks covering [from, to), offsets relative to the subtree
+    template<typename Fn>
+    static void visitRange(const Node *n, qsizetype from, qsizetype to, Fn &&fn) {
+        if (!n || from >= to) return;
+        const qsizetype leftLen = n->left ? n->left->length : 0;
+        const qsizetype pieceEnd = leftLen + n->piece.length;
+        if (from < leftLen)
+            visitRange(n->left.get(), from, qMin(to, leftLen), fn);
+        if (from < pieceEnd && to > leftLen) {
+            const qsizetype a = qMax(from, leftLen) - leftLen;
+            const qsizetype b = qMin(to, pieceEnd) - leftLen;
+            fn(n->piece.view().mid(a, b - a));
+        }
+        if (to > pieceEnd)
+            visitRange(n->right.get(), qMax(from, pieceEnd) - pieceEnd, to - pieceEnd, fn);
+    }
+};
+
+class DocumentSnapshot {
+public:
+    DocumentSnapshot() = default;
+    DocumentSnapshot(quint64 revision, const PieceTable &buffer)
+        : m_revision(revision), m_buffer(buffer.frozen()) {}
+
+    quint64   revision()  const { return m_revision; }
+    qsizetype length()    const { return m_buffer.length(); }
+    qsizetype lineCount() const { return m_buffer.lineCount(); }
+    bool      isEmpty()   const { return m_buffer.length() == 0; }
+
+    template<typename Fn>
+    void forEachChunk(Fn &&fn) const { m_buffer.forEachChunk(std::forward<Fn>(fn)); }
+
+    QString text(qsizetype pos, qsizetype len) const { return m_buffer.text(pos, len); }
+    QString lineAt(qsizetype line) const { return m_buffer.lineAt(line); }
+    qsizetype lineStart(qsizetype line) const { return m_buffer.lineStart(line); }
+    QString toString() const { return m_buffer.toString(); }
+
+private:
+    quint64    m_revision = 0;
+    PieceTable m_buffer;
+};
+
+// Collapses bursts of UI refreshes (cursor moves, key repeat, macro replay)
+// into at most one run of each task per frame.
+class FrameScheduler : public QObject {
+public:
+    enum Task { CurrentLine, CursorPosition, TabAppearance, VimHint };
+    static constexpr int FRAME_MS = 16;
+
+    static FrameScheduler *instance() {
+        static QPointer<FrameScheduler> scheduler;
+        if (!scheduler) scheduler = new FrameScheduler(qApp);
+        return scheduler;
+    }
+
+    // A task scheduled again before the frame runs replaces the pending one;
+    // it is dropped if the context object is destroyed in the meantime.
+    void schedule(QObject *context, Task task, std::function<void()> fn) {
+        const Key key{context, task};
+        if (!m_tasks.contains(key)) m_order.append(key);
+        m_tasks.insert(key, Pending{QPointer<QObject>(context), std::move(fn)});
+        if (m_timer.isActive()) return;
+        const qint64 sinceLast = m_lastFrame.isValid() ? m_lastFrame.elapsed() : FRAME_MS;
+        m_timer.start(int(qMax<qint64>(0, FRAME_MS - sinceLast)));
+    }
+
+private:
+    using Key = std::pair<QObject*, int>;
+    struct Pending {
+        QPointer<QObject>     context;
+        std::function<void()> fn;
+    };
+
+    explicit FrameScheduler(QObject *parent) : QObject(parent) {
+        m_timer.setSingleShot(true);
+        m_timer.setTimerType(Qt::PreciseTimer);
+        connect(&m_timer, &QTimer::timeout, this, &FrameScheduler::runFrame);
+    }
+
+    void runFrame() {
+        m_lastFrame.start();
+        const QList<Key> order = std::exchange(m_order, {});
+        QHash<Key, Pending> tasks = std::exchange(m_tasks, {});
+        for (const Key &key : order) {
+            const Pending pending = tasks.take(key);
+            if (pending.context) pending.fn();
+        }
+    }
+
+    QTimer              m_timer;
+    QElapsedTimer       m_lastFrame;
+    QList<Key>          m_order;
+    QHash<Key, Pending> m_tasks;
+};
+
 class VexEditor : public QPlainTextEdit {
     Q_OBJECT
 public:
@@ -362,29 +2061,421 @@ public:
     QTextDocument::FindFlags getFindFlags(bool caseSensitive, bool wholeWords) const;
     void setLineWrapping(bool wrap);
     bool isLineWrapping() const { return lineWrapEnabled; }
+    void loadText(const QString &text);
+    const PieceTable &buffer() const { return m_buffer; }
+    DocumentSnapshot snapshot() const { return DocumentSnapshot(m_revision, m_buffer); }
+    quint64 revision() const { return m_revision; }
+    AutosaveJournal *journal() const { return m_journal; }
+    bool hasExtraCursors() const { return !m_carets.isEmpty(); }
+    void clearExtraCursors();
+    void selectAllOccurrences();
+    void addNextOccurrence();
+    void addCursorVertical(int direction);
 
 public slots:
     void highlightCurrentLine();
+    void scheduleHighlight();
 
 signals:
     void modeChanged(Mode::ModeEnum mode);
     void saveRequested();
+    void quitRequested(bool force);
     void vimKeyPressed(const QString &keyDesc);
     void commandLineChanged(const QString &command);
     void commandExecuted(const QString &command, bool success);
 
-protected:
-    void resizeEvent(QResizeEvent *e) override;
-    void keyPressEvent(QKeyEvent *e) override;
+protected:
+    void resizeEvent(QResizeEvent *e) override;
+    void keyPressEvent(QKeyEvent *e) override;
+    void mousePressEvent(QMouseEvent *e) override;
+    void mouseMoveEvent(QMouseEvent *e) override;
+    void mouseReleaseEvent(QMouseEvent *e) override;
+
+private slots:
+    void updateLineNumberAreaWidth(int newBlockCount);
+    void updateLineNumberArea(const QRect &rect, int dy);
+    void syncBuffer(int position, int charsRemoved, int charsAdded);
+
+private:
+    struct Caret {
+        int anchor   = 0;
+        int position = 0;
+        int start() const { return qMin(anchor, position); }
+        int end()   const { return qMax(anchor, position); }
+        bool hasSelection() const { return anchor != position; }
+    };
+    struct CaretEdit {
+        int     start = 0;
+        int     end   = 0;
+        QString text;
+    };
+
+    QList<Caret> allCarets() const;
+    void setCarets(const QList<Caret> &carets);
+    void applyCaretEdits(QList<CaretEdit> edits);
+    void insertAtCarets(const QStringList &texts);
+    void deleteAtCarets(bool forward);
+    void moveCarets(QTextCursor::MoveOperation op, bool keepAnchor);
+    QString caretSelections() const;
+    bool handleCaretKey(QKeyEvent *e);
+    bool handleCaretCommand(QKeyEvent *e);
+    QPoint blockPosition(const QPoint &viewportPos) const;
+    void setBlockSelection(const QPoint &anchor, const QPoint &head);
+
+    QList<Caret>    m_carets;
+    bool            m_applyingCaretEdits = false;
+    bool            m_blockDrag = false;
+    bool            m_blockDragMoved = false;
+    QPoint          m_blockAnchor{-1, -1};
+    QPoint          m_blockHead{-1, -1};
+    LineNumberArea *lineNumberArea;
+    Mode            m_mode;
+    bool            lineWrapEnabled;
+    PieceTable      m_buffer;
+    quint64         m_revision;
+    int             m_docRevision;
+    bool            m_loadingText;
+    AutosaveJournal *m_journal;
+};
+
+class JournalWriter : public QObject {
+    Q_OBJECT
+public:
+    // Once the worker thread has been stopped on aboutToQuit, a writer that
+    // runs inline on the caller replaces it, so late flushes and discards
+    // during teardown neither touch the deleted worker nor get lost.
+    static JournalWriter *instance() {
+        static QPointer<JournalWriter> writer;
+        static bool shutDown = false;
+        if (shutDown && (!writer || !writer->m_inline)) {
+            writer = new JournalWriter(qApp);
+            writer->m_inline = true;
+        }
+        if (!writer) {
+            QThread *thread = new QThread;
+            thread->setObjectName("VexJournal");
+            writer = new JournalWriter;
+            writer->moveToThread(thread);
+            connect(thread, &QThread::finished, writer, &QObject::deleteLater);
+            connect(qApp, &QCoreApplication::aboutToQuit, thread, [thread]() {
+                shutDown = true;
+                thread->quit();
+                thread->wait();
+            });
+            thread->start(QThread::LowPriority);
+        }
+        return writer;
+    }
+
+    void append(const QString &path, const QByteArray &records) {
+        post([path, records]() {
+            QFile file(path);
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) return;
+            file.write(records);
+            syncToDisk(file);
+        });
+    }
+
+    void rewrite(const QString &path, const QByteArray &header, const DocumentSnapshot &snapshot) {
+        post([path, header, snapshot]() {
+            QSaveFile file(path);
+            if (!file.open(QIODevice::WriteOnly)) return;
+            file.write(header);
+            QDataStream out(&file);
+            out.setVersion(QDataStream::Qt_6_0);
+            out << quint8(SnapshotRecord) << qint64(snapshot.length());
+            snapshot.forEachChunk([&out](QStringView chunk) {
+                out.writeRawData(reinterpret_cast<const char *>(chunk.utf16()),
+                                 int(chunk.size() * sizeof(char16_t)));
+            });
+            file.commit();
+        });
+    }
+
+    void replace(const QString &path, const QByteArray &contents) {
+        post([path, contents]() {
+            QSaveFile file(path);
+            if (!file.open(QIODevice::WriteOnly)) return;
+            file.write(contents);
+            file.commit();
+        });
+    }
+
+    void remove(const QString &path) {
+        post([path]() { QFile::remove(path); });
+    }
+
+    void drain() {
+        if (!m_inline && thread()->isRunning())
+            QMetaObject::invokeMethod(this, []() {}, Qt::BlockingQueuedConnection);
+    }
+
+    enum Record : quint8 { SnapshotRecord = 1, EditRecord = 2, OriginRecord = 3 };
+
+private:
+    explicit JournalWriter(QObject *parent = nullptr) : QObject(parent) {}
+
+    template<typename Fn>
+    void post(Fn &&fn) {
+        if (m_inline)
+            fn();
+        else
+            QMetaObject::invokeMethod(this, std::forward<Fn>(fn), Qt::QueuedConnection);
+    }
+
+    bool m_inline = false;
+
+    static void syncToDisk(QFile &file) {
+        file.flush();
+#ifdef Q_OS_WIN
+        _commit(file.handle());
+#else
+        ::fsync(file.handle());
+#endif
+    }
+};
+
+class AutosaveJournal : public QObject {
+    Q_OBJECT
+public:
+    struct Recovered {
+        QString originalPath;
+        int     lineEnding = 0;
+        QString content;
+    };
+
+    explicit AutosaveJournal(VexEditor *editor)
+        : QObject(editor)
+        , m_editor(editor)
+        , m_active(false)
+        , m_sinceSnapshot(0)
+    {
+        static int serial = 0;
+        m_file = directory() + QString("/%1-%2-%3.vxj")
+                     .arg(QCoreApplication::applicationPid())
+                     .arg(InstanceRegistry::stamp())
+                     .arg(++serial);
+
+        m_flushTimer.setSingleShot(true);
+        m_flushTimer.setInterval(FLUSH_INTERVAL);
+        connect(&m_flushTimer, &QTimer::timeout, this, &AutosaveJournal::flush);
+    }
+
+    void setOrigin(const QString &path, int lineEnding) {
+        m_origin = path;
+        m_lineEnding = lineEnding;
+        if (!m_active) return;
+        QDataStream out(&m_pending, QIODevice::WriteOnly | QIODevice::Append);
+        out.setVersion(QDataStream::Qt_6_0);
+        out << quint8(JournalWriter::OriginRecord) << m_origin << qint32(m_lineEnding);
+        scheduleFlush();
+    }
+
+    void record(qint64 position, qint64 removed, const QString &inserted) {
+        if (!m_active) return;
+        QDataStream out(&m_pending, QIODevice::WriteOnly | QIODevice::Append);
+        out.setVersion(QDataStream::Qt_6_0);
+        out << quint8(JournalWriter::EditRecord) << position << removed << inserted;
+        m_sinceSnapshot += 17 + inserted.size() * 2;
+        if (m_sinceSnapshot > COMPACT_THRESHOLD)
+            writeSnapshot();
+        else
+            scheduleFlush();
+    }
+
+    void setModified(bool modified) {
+        if (modified)
+            writeSnapshot();
+        else
+            discard();
+    }
+
+    void resync() {
+        if (m_active) writeSnapshot();
+    }
+
+    void flush() {
+        m_flushTimer.stop();
+        if (m_pending.isEmpty()) return;
+        JournalWriter::instance()->append(m_file, m_pending);
+        m_pending.clear();
+    }
+
+    QString fileName() const { return m_file; }
+    bool isActive() const { return m_active; }
+
+    void discard() {
+        m_flushTimer.stop();
+        m_pending.clear();
+        if (m_active) {
+            JournalWriter::instance()->remove(m_file);
+            m_active = false;
+        }
+    }
+
+    static QString directory() {
+        QString dir = Settings::basePath() + "/.temp/journal";
+        QDir().mkpath(dir);
+        return dir;
+    }
+
+    static QStringList orphans() {
+        QStringList result;
+        const QSet<QString> live = InstanceRegistry::liveInstances();
+        QDir dir(directory());
+        const QStringList files = dir.entryList(QStringList() << "*.vxj", QDir::Files, QDir::Time | QDir::Reversed);
+        for (const QString &name : files) {
+            if (!live.contains(name.section('-', 0, 1)))
+                result.append(dir.absoluteFilePath(name));
+        }
+        return result;
+    }
+
+    static bool replay(const QString &path, Recovered &recovered) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) return false;
+
+        QDataStream in(&file);
+        in.setVersion(QDataStream::Qt_6_0);
+        quint32 magic = 0;
+        quint16 version = 0;
+        qint32 lineEnding = 0;
+        in >> magic >> version >> recovered.originalPath >> lineEnding;
+        if (in.status() != QDataStream::Ok || magic != MAGIC || version != VERSION)
+            return false;
+        recovered.lineEnding = lineEnding;
+
+        PieceTable table;
+        bool haveBase = false;
+        while (!in.atEnd()) {
+            quint8 type = 0;
+            in >> type;
+            if (type == JournalWriter::SnapshotRecord) {
+                qint64 length = 0;
+                in >> length;
+                if (in.status() != QDataStream::Ok || length < 0 || length * 2 > file.size()) break;
+                QString text(length, Qt::Uninitialized);
+                const int bytes = int(length * sizeof(char16_t));
+                if (in.readRawData(reinterpret_cast<char *>(text.data()), bytes) != bytes) break;
+                table.reset(text);
+                haveBase = true;
+            } else if (type == JournalWriter::EditRecord) {
+                qint64 position = 0, removed = 0;
+                QString inserted;
+                in >> position >> removed >> inserted;
+                if (in.status() != QDataStream::Ok) break;
+                table.replace(position, removed, inserted);
+            } else if (type == JournalWriter::OriginRecord) {
+                QString origin;
+                qint32 ending = 0;
+                in >> origin >> ending;
+                if (in.status() != QDataStream::Ok) break;
+                recovered.originalPath = origin;
+                recovered.lineEnding = ending;
+            } else {
+                break;
+            }
+        }
+
+        if (!haveBase) return false;
+        recovered.content = table.toString();
+        return true;
+    }
+
+private:
+    static constexpr quint32 MAGIC   = 0x56584a31;
+    static constexpr quint16 VERSION = 1;
+    static constexpr int     FLUSH_INTERVAL    = 1000;
+    static constexpr qint64  COMPACT_THRESHOLD = 1024 * 1024;
+
+    VexEditor  *m_editor;
+    QString     m_file;
+    QString     m_origin;
+    int         m_lineEnding = 0;
+    bool        m_active;
+    QByteArray  m_pending;
+    qint64      m_sinceSnapshot;
+    QTimer      m_flushTimer;
+
+    void scheduleFlush() {
+        if (!m_flushTimer.isActive())
+            m_flushTimer.start();
+    }
+
+    void writeSnapshot() {
+        m_flushTimer.stop();
+        m_pending.clear();
+        m_sinceSnapshot = 0;
+        m_active = true;
+
+        QByteArray header;
+        QDataStream out(&header, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_6_0);
+        out << MAGIC << VERSION << m_origin << qint32(m_lineEnding);
+        JournalWriter::instance()->rewrite(m_file, header, m_editor->snapshot());
+    }
+};
+
+class WorkspaceSession {
+public:
+    struct Tab {
+        QString path;
+        QString journal;
+        qint32  lineEnding = 0;
+        QString syntax;
+        qint32  anchor   = 0;
+        qint32  position = 0;
+        qint32  vscroll  = 0;
+        qint32  hscroll  = 0;
+    };
+
+    struct State {
+        qint32     current = -1;
+        QList<Tab> tabs;
+    };
+
+    static QString filePath() {
+        return Settings::basePath() + "/workspace.vxs";
+    }
+
+    static QByteArray encode(const State &state) {
+        QByteArray bytes;
+        QDataStream out(&bytes, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_6_0);
+        out << MAGIC << VERSION << state.current << qint32(state.tabs.size());
+        for (const Tab &tab : state.tabs) {
+            out << tab.path << tab.journal << tab.lineEnding << tab.syntax
+                << tab.anchor << tab.position << tab.vscroll << tab.hscroll;
+        }
+        return bytes;
+    }
+
+    static bool load(State &state) {
+        QFile file(filePath());
+        if (!file.open(QIODevice::ReadOnly)) return false;
+
+        QDataStream in(&file);
+        in.setVersion(QDataStream::Qt_6_0);
+        quint32 magic = 0;
+        quint16 version = 0;
+        qint32 count = 0;
+        in >> magic >> version >> state.current >> count;
+        if (in.status() != QDataStream::Ok || magic != MAGIC || version != VERSION || count < 0)
+            return false;
 
-private slots:
-    void updateLineNumberAreaWidth(int newBlockCount);
-    void updateLineNumberArea(const QRect &rect, int dy);
+        for (qint32 i = 0; i < count; ++i) {
+            Tab tab;
+            in >> tab.path >> tab.journal >> tab.lineEnding >> tab.syntax
+               >> tab.anchor >> tab.position >> tab.vscroll >> tab.hscroll;
+            if (in.status() != QDataStream::Ok) return false;
+            state.tabs.append(tab);
+        }
+        return true;
+    }
 
 private:
-    LineNumberArea *lineNumberArea;
-    Mode            m_mode;
-    bool            lineWrapEnabled;
+    static constexpr quint32 MAGIC   = 0x56585331;
+    static constexpr quint16 VERSION = 1;
 };
 
 class LineNumberArea : public QWidget {
@@ -410,13 +2501,23 @@ VexEditor::VexEditor(QWidget *parent)
     : QPlainTextEdit(parent)
     , lineNumberArea(new LineNumberArea(this))
     , lineWrapEnabled(false)
+    , m_revision(0)
+    , m_docRevision(0)
+    , m_loadingText(false)
+    , m_journal(nullptr)
 {
     setObjectName("VexEditor");
     setLineWrapMode(QPlainTextEdit::NoWrap);
     setTabStopDistance(40);
     connect(this, &QPlainTextEdit::blockCountChanged,     this, &VexEditor::updateLineNumberAreaWidth);
     connect(this, &QPlainTextEdit::updateRequest,         this, &VexEditor::updateLineNumberArea);
-    connect(this, &QPlainTextEdit::cursorPositionChanged, this, &VexEditor::highlightCurrentLine);
+    connect(this, &QPlainTextEdit::cursorPositionChanged, this, &VexEditor::scheduleHighlight);
+    connect(document(), &QTextDocument::contentsChange,   this, &VexEditor::syncBuffer);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, [this]() {
+        if (!m_carets.isEmpty()) scheduleHighlight();
+    });
+    m_journal = new AutosaveJournal(this);
+    connect(document(), &QTextDocument::modificationChanged, m_journal, &AutosaveJournal::setModified);
     updateLineNumberAreaWidth(0);
     highlightCurrentLine();
 }
@@ -429,7 +2530,8 @@ void VexEditor::setupMode(QPushButton *btn) {
         [this](const QString &c)         { emit commandLineChanged(c); },
         [this](const QString &c, bool s) { emit commandExecuted(c, s); },
         [this](Mode::ModeEnum m)         { emit modeChanged(m); },
-        [this](QKeyEvent *e)             { QPlainTextEdit::keyPressEvent(e); }
+        [this](QKeyEvent *e)             { QPlainTextEdit::keyPressEvent(e); },
+        [this](bool force)               { emit quitRequested(force); }
         );
     m_mode.setupButton();
 }
@@ -480,6 +2582,62 @@ void VexEditor::setLineWrapping(bool wrap) {
     viewport()->update();
 }
 
+void VexEditor::loadText(const QString &text) {
+    m_carets.clear();
+    m_buffer.reset(text);
+    ++m_revision;
+    m_loadingText = true;
+    setPlainText(text);
+    m_loadingText = false;
+    m_docRevision = document()->revision();
+    m_journal->resync();
+}
+
+void VexEditor::syncBuffer(int position, int charsRemoved, int charsAdded) {
+    if (m_loadingText) return;
+
+    const qsizetype oldLength = m_buffer.length();
+    const qsizetype docLength = document()->characterCount() - 1;
+    // Edits touching the end of the document include the implicit final
+    // paragraph separator in both counts; clamp them to the real text.
+    qsizetype removed = qMin<qsizetype>(charsRemoved, oldLength - qMin<qsizetype>(position, oldLength));
+    qsizetype added   = docLength - oldLength + removed;
+    // Highlighters report restyled blocks as same-length changes without
+    // bumping the document revision; those leave the text alone and must not
+    // fragment the buffer or drop extra cursors.
+    const int docRevision = document()->revision();
+    if (removed == added && docRevision == m_docRevision) return;
+    m_docRevision = docRevision;
+    if (position > oldLength || added < 0 || position + added > docLength) {
+        QString raw = document()->toRawText();
+        raw.replace(QChar::ParagraphSeparator, QLatin1Char('\n'));
+        m_buffer.reset(raw);
+        ++m_revision;
+        m_journal->resync();
+        return;
+    }
+
+    QString inserted;
+    if (added > 0) {
+        QTextCursor cursor(document());
+        cursor.setPosition(position);
+        cursor.setPosition(position + added, QTextCursor::KeepAnchor);
+        inserted = cursor.selectedText();
+        inserted.replace(QChar::ParagraphSeparator, QLatin1Char('\n'));
+    }
+    // Explicit char-format edits do bump the revision but keep the text.
+    if (removed == added && m_buffer.matches(position, inserted)) return;
+
+    if (!m_applyingCaretEdits && !m_carets.isEmpty()) {
+        m_carets.clear();
+        m_blockAnchor = m_blockHead = QPoint(-1, -1);
+        scheduleHighlight();
+    }
+    m_buffer.replace(position, removed, inserted);
+    ++m_revision;
+    m_journal->record(position, removed, inserted);
+}
+
 void VexEditor::resizeEvent(QResizeEvent *e) {
     QPlainTextEdit::resizeEvent(e);
     QRect cr = contentsRect();
@@ -487,9 +2645,394 @@ void VexEditor::resizeEvent(QResizeEvent *e) {
 }
 
 void VexEditor::keyPressEvent(QKeyEvent *e) {
+    if (m_mode.current() != Mode::MODE_CMD && handleCaretCommand(e)) return;
+    if (!m_carets.isEmpty() && handleCaretKey(e)) return;
     m_mode.handleKey(this, e);
 }
 
+void VexEditor::mousePressEvent(QMouseEvent *e) {
+    if (e->button() == Qt::LeftButton && (e->modifiers() & Qt::AltModifier)) {
+        m_blockDrag = true;
+        m_blockDragMoved = false;
+        m_blockAnchor = m_blockHead = blockPosition(e->position().toPoint());
+        e->accept();
+        return;
+    }
+    if (!m_carets.isEmpty()) clearExtraCursors();
+    m_blockAnchor = m_blockHead = QPoint(-1, -1);
+    QPlainTextEdit::mousePressEvent(e);
+}
+
+void VexEditor::mouseMoveEvent(QMouseEvent *e) {
+    if (m_blockDrag) {
+        const QPoint head = blockPosition(e->position().toPoint());
+        if (head != m_blockHead || m_blockDragMoved) {
+            m_blockDragMoved = true;
+            setBlockSelection(m_blockAnchor, head);
+        }
+        e->accept();
+        return;
+    }
+    QPlainTextEdit::mouseMoveEvent(e);
+}
+
+void VexEditor::mouseReleaseEvent(QMouseEvent *e) {
+    if (m_blockDrag) {
+        m_blockDrag = false;
+        if (!m_blockDragMoved) {
+            // Alt+click without dragging drops an extra cursor
+            const int pos = cursorForPosition(e->position().toPoint()).position();
+            QList<Caret> carets = allCarets();
+            carets.prepend(Caret{pos, pos});
+            setCarets(carets);
+            m_blockAnchor = m_blockHead = QPoint(-1, -1);
+        }
+        e->accept();
+        return;
+    }
+    QPlainTextEdit::mouseReleaseEvent(e);
+}
+
+QList<VexEditor::Caret> VexEditor::allCarets() const {
+    const QTextCursor primary = textCursor();
+    QList<Caret> carets;
+    carets.reserve(m_carets.size() + 1);
+    carets.append(Caret{primary.anchor(), primary.position()});
+    carets.append(m_carets);
+    return carets;
+}
+
+void VexEditor::setCarets(const QList<Caret> &carets) {
+    if (carets.isEmpty()) return;
+    const int last = document()->characterCount() - 1;
+    auto clamp = [last](Caret c) {
+        c.anchor = qBound(0, c.anchor, last);
+        c.position = qBound(0, c.position, last);
+        return c;
+    };
+    auto key = [](const Caret &c) { return (quint64(quint32(c.position)) << 32) | quint32(c.anchor); };
+
+    const Caret primary = clamp(carets.first());
+    QSet<quint64> seen;
+    seen.reserve(carets.size());
+    seen.insert(key(primary));
+    m_carets.clear();
+    m_carets.reserve(carets.size() - 1);
+    for (qsizetype i = 1; i < carets.size(); ++i) {
+        const Caret c = clamp(carets.at(i));
+        if (seen.contains(key(c))) continue;
+        seen.insert(key(c));
+        m_carets.append(c);
+    }
+
+    QTextCursor cursor = textCursor();
+    cursor.setPosition(primary.anchor);
+    cursor.setPosition(primary.position, QTextCursor::KeepAnchor);
+    setTextCursor(cursor);
+    scheduleHighlight();
+}
+
+void VexEditor::clearExtraCursors() {
+    m_carets.clear();
+    m_blockAnchor = m_blockHead = QPoint(-1, -1);
+    scheduleHighlight();
+}
+
+// All edits are resolved against the current revision and applied back to front
+// in one edit block, so the document relayouts and syncBuffer runs only once.
+void VexEditor::applyCaretEdits(QList<CaretEdit> edits) {
+    if (edits.isEmpty()) return;
+
+    QList<int> order(edits.size());
+    for (int i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&edits](int a, int b) {
+        return edits.at(a).start != edits.at(b).start ? edits.at(a).start < edits.at(b).start : a < b;
+    });
+
+    int prevEnd = -1;
+    for (int idx : std::as_const(order)) {
+        CaretEdit &edit = edits[idx];
+        if (edit.start < prevEnd) edit.start = prevEnd;
+        if (edit.end < edit.start) edit.end = edit.start;
+        prevEnd = edit.end;
+    }
+
+    m_applyingCaretEdits = true;
+    QTextCursor cursor(document());
+    cursor.beginEditBlock();
+    for (auto it = order.crbegin(); it != order.crend(); ++it) {
+        const CaretEdit &edit = edits.at(*it);
+        if (edit.start == edit.end && edit.text.isEmpty()) continue;
+        cursor.setPosition(edit.start);
+        cursor.setPosition(edit.end, QTextCursor::KeepAnchor);
+        cursor.insertText(edit.text);
+    }
+    cursor.endEditBlock();
+    m_applyingCaretEdits = false;
+
+    QList<Caret> carets(edits.size());
+    int delta = 0;
+    for (int idx : std::as_const(order)) {
+        const CaretEdit &edit = edits.at(idx);
+        const int pos = edit.start + delta + int(edit.text.size());
+        carets[idx] = Caret{pos, pos};
+        delta += int(edit.text.size()) - (edit.end - edit.start);
+    }
+    setCarets(carets);
+}
+
+void VexEditor::insertAtCarets(const QStringList &texts) {
+    const QList<Caret> carets = allCarets();
+    QList<CaretEdit> edits;
+    edits.reserve(carets.size());
+    for (const Caret &c : carets)
+        edits.append(CaretEdit{c.start(), c.end(), texts.value(0)});
+
+    // Per-cursor texts are handed out in document order, matching caretSelections()
+    if (texts.size() == carets.size()) {
+        QList<int> order(carets.size());
+        for (int i = 0; i < order.size(); ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&carets](int a, int b) {
+            return carets.at(a).start() < carets.at(b).start();
+        });
+        for (int i = 0; i < order.size(); ++i)
+            edits[order.at(i)].text = texts.at(i);
+    }
+    applyCaretEdits(edits);
+}
+
+void VexEditor::deleteAtCarets(bool forward) {
+    const int last = document()->characterCount() - 1;
+    const QList<Caret> carets = allCarets();
+    QList<CaretEdit> edits;
+    edits.reserve(carets.size());
+    for (const Caret &c : carets) {
+        if (c.hasSelection())
+            edits.append(CaretEdit{c.start(), c.end(), QString()});
+        else if (forward)
+            edits.append(CaretEdit{c.position, qMin(c.position + 1, last), QString()});
+        else
+            edits.append(CaretEdit{qMax(c.position - 1, 0), c.position, QString()});
+    }
+    applyCaretEdits(edits);
+}
+
+void VexEditor::moveCarets(QTextCursor::MoveOperation op, bool keepAnchor) {
+    QList<Caret> carets = allCarets();
+    QTextCursor cursor(document());
+    const auto mode = keepAnchor ? QTextCursor::KeepAnchor : QTextCursor::MoveAnchor;
+    for (Caret &c : carets) {
+        cursor.setPosition(c.anchor);
+        cursor.setPosition(c.position, QTextCursor::KeepAnchor);
+        if (!keepAnchor && c.hasSelection() && (op == QTextCursor::Left || op == QTextCursor::Right)) {
+            const int pos = op == QTextCursor::Left ? c.start() : c.end();
+            c = Caret{pos, pos};
+            continue;
+        }
+        cursor.movePosition(op, mode);
+        c = Caret{cursor.anchor(), cursor.position()};
+    }
+    m_blockAnchor = m_blockHead = QPoint(-1, -1);
+    setCarets(carets);
+}
+
+QString VexEditor::caretSelections() const {
+    QList<Caret> carets = allCarets();
+    std::stable_sort(carets.begin(), carets.end(), [](const Caret &a, const Caret &b) { return a.start() < b.start(); });
+    QStringList parts;
+    parts.reserve(carets.size());
+    for (const Caret &c : std::as_const(carets))
+        parts.append(m_buffer.text(c.start(), c.end() - c.start()));
+    return parts.join(QLatin1Char('\n'));
+}
+
+bool VexEditor::handleCaretKey(QKeyEvent *e) {
+    if (e->key() == Qt::Key_Escape) {
+        clearExtraCursors();
+        return true;
+    }
+    if (m_mode.current() != Mode::MODE_INS) return false;
+
+    const Qt::KeyboardModifiers mods = e->modifiers() & ~Qt::KeypadModifier;
+    const bool shift = mods & Qt::ShiftModifier;
+    const bool ctrl  = mods & Qt::ControlModifier;
+
+    switch (e->key()) {
+    case Qt::Key_Left:  moveCarets(ctrl ? QTextCursor::WordLeft  : QTextCursor::Left,  shift); return true;
+    case Qt::Key_Right: moveCarets(ctrl ? QTextCursor::WordRight : QTextCursor::Right, shift); return true;
+    case Qt::Key_Up:    moveCarets(QTextCursor::Up,   shift); return true;
+    case Qt::Key_Down:  moveCarets(QTextCursor::Down, shift); return true;
+    case Qt::Key_Home:  moveCarets(QTextCursor::StartOfLine, shift); return true;
+    case Qt::Key_End:   moveCarets(QTextCursor::EndOfLine,   shift); return true;
+    case Qt::Key_Backspace: deleteAtCarets(false); return true;
+    case Qt::Key_Delete:    deleteAtCarets(true);  return true;
+    case Qt::Key_Return:
+    case Qt::Key_Enter:     insertAtCarets({QStringLiteral("\n")}); return true;
+    case Qt::Key_Tab:       insertAtCarets({QStringLiteral("\t")}); return true;
+    default: break;
+    }
+
+    if (ctrl && (e->key() == Qt::Key_C || e->key() == Qt::Key_X)) {
+        QApplication::clipboard()->setText(caretSelections());
+        if (e->key() == Qt::Key_X) insertAtCarets({QString()});
+        return true;
+    }
+    if (ctrl && e->key() == Qt::Key_V) {
+        QString text = QApplication::clipboard()->text();
+        text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+        QStringList lines = text.split(QLatin1Char('\n'));
+        if (lines.size() > 1 && lines.last().isEmpty()) lines.removeLast();
+        // One clipboard line per cursor when the counts match, otherwise the whole text everywhere
+        insertAtCarets(lines.size() == m_carets.size() + 1 ? lines : QStringList{text});
+        return true;
+    }
+
+    const QString text = e->text();
+    if (!(mods & (Qt::ControlModifier | Qt::AltModifier | Qt::MetaModifier))
+        && !text.isEmpty() && text.at(0).isPrint()) {
+        insertAtCarets({text});
+        return true;
+    }
+    return false;
+}
+
+bool VexEditor::handleCaretCommand(QKeyEvent *e) {
+    const Qt::KeyboardModifiers mods = e->modifiers() & ~Qt::KeypadModifier;
+
+    if (mods == (Qt::ControlModifier | Qt::AltModifier)
+        && (e->key() == Qt::Key_Up || e->key() == Qt::Key_Down)) {
+        addCursorVertical(e->key() == Qt::Key_Up ? -1 : 1);
+        return true;
+    }
+    if (mods == (Qt::ControlModifier | Qt::ShiftModifier) && e->key() == Qt::Key_L) {
+        selectAllOccurrences();
+        return true;
+    }
+    if (mods == Qt::ControlModifier && e->key() == Qt::Key_D) {
+        addNextOccurrence();
+        return true;
+    }
+    if (mods == (Qt::AltModifier | Qt::ShiftModifier)) {
+        QPoint step;
+        switch (e->key()) {
+        case Qt::Key_Left:  step = QPoint(-1, 0); break;
+        case Qt::Key_Right: step = QPoint(1, 0);  break;
+        case Qt::Key_Up:    step = QPoint(0, -1); break;
+        case Qt::Key_Down:  step = QPoint(0, 1);  break;
+        default: return false;
+        }
+        if (m_blockAnchor.x() < 0) {
+            const QTextCursor cursor = textCursor();
+            m_blockAnchor = m_blockHead = QPoint(cursor.positionInBlock(), cursor.blockNumber());
+        }
+        QPoint head = m_blockHead + step;
+        head.setX(qMax(0, head.x()));
+        head.setY(qBound(0, head.y(), document()->blockCount() - 1));
+        setBlockSelection(m_blockAnchor, head);
+        return true;
+    }
+    return false;
+}
+
+// x is the column (past the end of short lines when the pointer is), y the line
+QPoint VexEditor::blockPosition(const QPoint &viewportPos) const {
+    const QTextCursor cursor = cursorForPosition(viewportPos);
+    int column = cursor.positionInBlock();
+    if (cursor.atBlockEnd()) {
+        const int spaceWidth = qMax(1, fontMetrics().horizontalAdvance(QLatin1Char(' ')));
+        const int past = viewportPos.x() - cursorRect(cursor).left();
+        if (past > 0) column += past / spaceWidth;
+    }
+    return QPoint(column, cursor.blockNumber());
+}
+
+void VexEditor::setBlockSelection(const QPoint &anchor, const QPoint &head) {
+    const int step = head.y() >= anchor.y() ? 1 : -1;
+    QList<Caret> carets;
+    carets.reserve(qAbs(head.y() - anchor.y()) + 1);
+    QTextBlock block = document()->findBlockByNumber(anchor.y());
+    for (int line = anchor.y(); block.isValid(); line += step) {
+        const int length = block.length() - 1;
+        const int a = block.position() + qMin(anchor.x(), length);
+        const int h = block.position() + qMin(head.x(), length);
+        carets.append(Caret{a, h});
+        if (line == head.y()) break;
+        block = step > 0 ? block.next() : block.previous();
+    }
+    if (carets.isEmpty()) return;
+    // The head line carries the primary cursor so the view follows it
+    carets.prepend(carets.takeLast());
+    setCarets(carets);
+    m_blockAnchor = anchor;
+    m_blockHead = head;
+}
+
+void VexEditor::addCursorVertical(int direction) {
+    QList<Caret> carets = allCarets();
+    const Caret edge = *std::min_element(carets.cbegin(), carets.cend(), [direction](const Caret &a, const Caret &b) {
+        return direction < 0 ? a.position < b.position : a.position > b.position;
+    });
+    const QTextBlock from = document()->findBlock(edge.position);
+    const QTextBlock to = direction < 0 ? from.previous() : from.next();
+    if (!to.isValid()) return;
+    const int pos = to.position() + qMin(edge.position - from.position(), to.length() - 1);
+    carets.prepend(Caret{pos, pos});
+    setCarets(carets);
+}
+
+static QString occurrenceNeedle(QTextCursor cursor) {
+    if (!cursor.hasSelection()) cursor.select(QTextCursor::WordUnderCursor);
+    return cursor.selectedText();
+}
+
+void VexEditor::selectAllOccurrences() {
+    const QTextCursor primary = textCursor();
+    const QString needle = occurrenceNeedle(primary);
+    if (needle.isEmpty() || needle.contains(QChar::ParagraphSeparator)) return;
+
+    const QString text = m_buffer.toString();
+    QList<Caret> carets;
+    int primaryIndex = 0;
+    for (qsizetype at = text.indexOf(needle); at >= 0; at = text.indexOf(needle, at + needle.size())) {
+        if (at <= primary.position() && primary.position() <= at + needle.size())
+            primaryIndex = int(carets.size());
+        carets.append(Caret{int(at), int(at + needle.size())});
+    }
+    if (carets.isEmpty()) return;
+    carets.swapItemsAt(0, primaryIndex);
+    m_blockAnchor = m_blockHead = QPoint(-1, -1);
+    setCarets(carets);
+}
+
+void VexEditor::addNextOccurrence() {
+    const QTextCursor primary = textCursor();
+    if (!primary.hasSelection()) {
+        QTextCursor word = primary;
+        word.select(QTextCursor::WordUnderCursor);
+        if (!word.hasSelection()) return;
+        QList<Caret> carets = allCarets();
+        carets[0] = Caret{word.anchor(), word.position()};
+        setCarets(carets);
+        return;
+    }
+
+    const QString needle = primary.selectedText();
+    if (needle.contains(QChar::ParagraphSeparator)) return;
+    QList<Caret> carets = allCarets();
+    int from = 0;
+    for (const Caret &c : std::as_const(carets)) from = qMax(from, c.end());
+
+    const QString text = m_buffer.toString();
+    qsizetype at = text.indexOf(needle, from);
+    if (at < 0) at = text.indexOf(needle);
+    if (at < 0) return;
+    const Caret next{int(at), int(at + needle.size())};
+    for (const Caret &c : std::as_const(carets))
+        if (c.start() == next.start && c.end() == next.end()) return;
+    carets.prepend(next);
+    setCarets(carets);
+}
+
 void VexEditor::updateLineNumberAreaWidth(int) {
     setViewportMargins(lineNumberAreaWidth(), 0, 0, 0);
 }
@@ -503,6 +3046,10 @@ void VexEditor::updateLineNumberArea(const QRect &rect, int dy) {
         updateLineNumberAreaWidth(0);
 }
 
+void VexEditor::scheduleHighlight() {
+    FrameScheduler::instance()->schedule(this, FrameScheduler::CurrentLine, [this]() { highlightCurrentLine(); });
+}
+
 void VexEditor::highlightCurrentLine() {
     QList<QTextEdit::ExtraSelection> extraSelections;
     if (!isReadOnly()) {
@@ -514,6 +3061,38 @@ void VexEditor::highlightCurrentLine() {
         selection.cursor.clearSelection();
         extraSelections.append(selection);
     }
+    if (!m_carets.isEmpty()) {
+        // Only cursors inside the viewport get an extra selection
+        const QTextBlock firstBlock = firstVisibleBlock();
+        const int first = firstBlock.position();
+        const int lastLine = firstBlock.blockNumber()
+                             + viewport()->height() / qMax(1, fontMetrics().lineSpacing()) + 1;
+        const QTextBlock lastBlock = document()->findBlockByNumber(lastLine);
+        const int last = lastBlock.isValid() ? lastBlock.position() + lastBlock.length()
+                                             : document()->characterCount();
+
+        QTextEdit::ExtraSelection caret;
+        caret.format.setBackground(palette().text());
+        caret.format.setForeground(palette().base());
+        QTextEdit::ExtraSelection selected;
+        selected.format.setBackground(palette().highlight());
+        selected.format.setForeground(palette().highlightedText());
+
+        for (const Caret &c : std::as_const(m_carets)) {
+            if (c.end() < first || c.start() > last) continue;
+            if (c.hasSelection()) {
+                selected.cursor = QTextCursor(document());
+                selected.cursor.setPosition(c.anchor);
+                selected.cursor.setPosition(c.position, QTextCursor::KeepAnchor);
+                extraSelections.append(selected);
+            }
+            caret.cursor = QTextCursor(document());
+            caret.cursor.setPosition(c.position);
+            // At a line end this covers the separator, which the layout draws as a one-space box
+            caret.cursor.movePosition(QTextCursor::NextCharacter, QTextCursor::KeepAnchor);
+            extraSelections.append(caret);
+        }
+    }
     setExtraSelections(extraSelections);
 }
 
@@ -826,16 +3405,28 @@ public:
     }
 
     QByteArray encode(const QString &text) const {
-        QString s = text;
-        s.replace("\r\n", "\n");
-        s.replace('\r', '\n');
-        switch (m_type) {
-        case CRLF: s.replace('\n', "\r\n"); break;
-        case CR:   s.replace('\n', '\r');   break;
-        default:   break;
-        }
-        QStringEncoder enc(QStringConverter::Utf8);
-        return enc(s);
+        QByteArray result;
+        encodeChunks([&](auto &&sink) { sink(QStringView(text)); },
+                     [&](QByteArray &block) { result = std::move(block); });
+        return result;
+    }
+
+    QByteArray encode(const DocumentSnapshot &snapshot) const {
+        QByteArray result;
+        encodeChunks([&](auto &&sink) { snapshot.forEachChunk(sink); },
+                     [&](QByteArray &block) { result = std::move(block); });
+        return result;
+    }
+
+    bool encodeTo(QIODevice *device, const DocumentSnapshot &snapshot) const {
+        bool ok = true;
+        encodeChunks([&](auto &&sink) { snapshot.forEachChunk(sink); },
+                     [&](QByteArray &block) {
+                         if (ok && device->write(block) != block.size())
+                             ok = false;
+                     },
+                     STREAM_BLOCK);
+        return ok;
     }
 
     void setupUi(QStatusBar *statusBar) {
@@ -892,8 +3483,66 @@ signals:
     void lineEndingChanged();
 
 private:
+    static constexpr qsizetype STREAM_BLOCK = 256 * 1024;
+
     Type m_type;
     QPushButton *m_button = nullptr;
+
+    QByteArray eol() const {
+        switch (m_type) {
+        case CRLF: return QByteArrayLiteral("\r\n");
+        case CR:   return QByteArrayLiteral("\r");
+        default:   return QByteArrayLiteral("\n");
+        }
+    }
+
+    template<typename Source, typename Flush>
+    void encodeChunks(Source &&source, Flush &&flush, qsizetype blockSize = 0) const {
+        QStringEncoder enc(QStringConverter::Utf8);
+        const QByteArray lineEnd = eol();
+        QByteArray out;
+        bool pendingCr = false;
+        auto spill = [&]() {
+            if (blockSize > 0 && out.size() >= blockSize) {
+                flush(out);
+                out.clear();
+            }
+        };
+
+        source([&](QStringView chunk) {
+            qsizetype runStart = 0;
+            for (qsizetype i = 0; i < chunk.size(); ++i) {
+                const QChar c = chunk[i];
+                if (c != QLatin1Char('\r') && c != QLatin1Char('\n')) {
+                    if (pendingCr) {
+                        out += lineEnd;
+                        pendingCr = false;
+                    }
+                    continue;
+                }
+                if (i > runStart) {
+                    out += enc(chunk.mid(runStart, i - runStart));
+                    spill();
+                }
+                runStart = i + 1;
+                if (c == QLatin1Char('\n')) {
+                    out += lineEnd;
+                    pendingCr = false;
+                } else {
+                    if (pendingCr) out += lineEnd;
+                    pendingCr = true;
+                }
+            }
+            if (chunk.size() > runStart) {
+                out += enc(chunk.mid(runStart));
+                spill();
+            }
+        });
+
+        if (pendingCr)
+            out += lineEnd;
+        flush(out);
+    }
 };
 
 class VexWidget : public QWidget {
@@ -903,7 +3552,9 @@ class VexWidget : public QWidget {
 public:
     explicit VexWidget(QWidget *parent = nullptr);
     ~VexWidget();
-    void openFileAtPath(const QString &path);
+    Q_INVOKABLE void openFileAtPath(const QString &path);
+    void openFiles(const QStringList &paths, int line = 0);
+    void gotoLine(int line);
     QTabWidget* getTabWidget() { return tabWidget; }
     QString getFilePath(VexEditor *editor) { return filePaths.value(editor); }
     void setupUI(QMainWindow *mainWin);
@@ -935,8 +3586,7 @@ private slots:
     void restoreToolbarState();
     void saveSessionAndQuit();
     void loadSavedSession();
-    void handleInstanceRequest(const QString &requestFilePath);
-    void onSettingsFileChanged(const QString &path);
+    void onThemeSettingsChanged();
     void onLineEndingChanged();
 
 protected:
@@ -946,11 +3596,52 @@ protected:
     void closeEvent(QCloseEvent *event) override;
 
 private:
+    struct PendingRestore {
+        enum Kind { Legacy, Journal, File };
+        Kind    kind    = Journal;
+        QString source;
+        bool    decoded = false;
+        AutosaveJournal::Recovered data;
+        WorkspaceSession::Tab view;
+    };
+
+    struct OpenBatch {
+        QStringList        paths;
+        QList<VexEditor*>  editors;
+        QStringList        deferred;
+        int                remaining = 0;
+        int                line      = 0;
+        QElapsedTimer      clock;
+    };
+
     void saveSettings();
+    VexEditor* addRestorePlaceholder(const WorkspaceSession::Tab &view);
+    void onRestoreDecoded(VexEditor *editor, const AutosaveJournal::Recovered &recovered, bool ok);
+    void materializeRestore(VexEditor *editor);
+    void materializeNextRestore();
+    void finishSessionRestore();
+    void dropPendingRestores();
+    static bool readLegacySession(const QString &path, AutosaveJournal::Recovered &recovered);
+    static bool readTextFile(const QString &path, bool whitelisted, AutosaveJournal::Recovered &recovered);
+    VexEditor* createEditor();
+    VexEditor* addFileTab(const QString &filePath, const QString &content, LineEnding::Type type, int position = -1);
+    void addRecentFiles(const QStringList &paths);
+    void onBatchFileDecoded(const QSharedPointer<OpenBatch> &batch, qsizetype ordinal,
+                            const AutosaveJournal::Recovered &decoded, bool ok);
+    void finishOpenBatch(const QSharedPointer<OpenBatch> &batch);
+    void scheduleWorkspaceSave();
+    void saveWorkspace();
+    void trackWorkspace(VexEditor *editor);
+    WorkspaceSession::State captureWorkspace() const;
+    static void applyViewState(VexEditor *editor, const WorkspaceSession::Tab &view);
     void updateRecentMenu();
     void updateTabAppearance(int tabIndex);
+    const QPair<QIcon, QIcon> &tabIcons(const QString &filePath);
+    void scheduleCursorPosition();
+    void scheduleTabAppearance(VexEditor *editor);
+    void showVimHint(const QString &text, bool transient);
     void updateWindowTitle(QMainWindow *mainWin);
-    bool hasBinaryContent(const QByteArray &data) const;
+    static bool hasBinaryContent(const QByteArray &data);
     VexEditor* getCurrentEditor();
     QString getCurrentWorkingDirectory() const;
 
@@ -959,22 +3650,31 @@ private:
     QPushButton    *modeLabel;
     QLabel         *positionLabel;
     QLabel         *vimHintLabel;
+    QTimer         *vimHintTimer;
+    QString         m_vimHint;
     QAction        *lineWrapAction;
     LineEnding     *m_lineEnding;
     QMap<VexEditor*, QString> filePaths;
     QMap<VexEditor*, LineEnding::Type> editorLineEndings;
+    QHash<QString, QPair<QIcon, QIcon>> m_tabIcons;
     FindReplaceDialog *findDialog;
     QString currentFindText;
     QString currentReplaceText;
     bool currentCaseSensitive;
     bool currentWholeWords;
     QFileSystemWatcher *fileWatcher;
-    QFileSystemWatcher *m_settingsWatcher;
     AdminFileHandler    adminHandler;
     QMenu          *recentMenu;
     EmptyStateView *emptyView;
     QMainWindow    *m_mainWindow;
     bool            m_sessionRestored;
+    QHash<VexEditor*, PendingRestore> m_pendingRestore;
+    QTimer         *m_idleRestoreTimer;
+    QTimer         *m_workspaceTimer;
+    QElapsedTimer   m_restoreClock;
+    qint64          m_restoreStart = 0;
+    int             m_restoreOutstanding;
+    bool            m_workspaceReady;
     const int MAX_RECENT_FILES = 10;
 };
 
@@ -991,212 +3691,416 @@ VexWidget::VexWidget(QWidget *parent)
     , modeLabel(nullptr)
 
     , m_lineEnding(nullptr)
-    , m_settingsWatcher(nullptr)
+    , vimHintTimer(nullptr)
+    , m_idleRestoreTimer(nullptr)
+    , m_workspaceTimer(nullptr)
+    , m_restoreOutstanding(0)
+    , m_workspaceReady(false)
 {
     setAcceptDrops(true);
+    m_idleRestoreTimer = new QTimer(this);
+    m_idleRestoreTimer->setInterval(0);
+    connect(m_idleRestoreTimer, &QTimer::timeout, this, &VexWidget::materializeNextRestore);
+    m_workspaceTimer = new QTimer(this);
+    m_workspaceTimer->setSingleShot(true);
+    m_workspaceTimer->setInterval(500);
+    connect(m_workspaceTimer, &QTimer::timeout, this, &VexWidget::saveWorkspace);
     fileWatcher = new QFileSystemWatcher(this);
     connect(fileWatcher, &QFileSystemWatcher::fileChanged, this, [this](const QString &path) {
         if (m_mainWindow) {
             m_mainWindow->statusBar()->showMessage("File modified externally: " + QFileInfo(path).fileName(), 3000);
         }
     });
-    m_settingsWatcher = new QFileSystemWatcher(this);
-    QString configPath = Settings::instance().configFilePath();
-    if (QFile::exists(configPath)) {
-        m_settingsWatcher->addPath(configPath);
+    Settings::instance().subscribe("theme/*", this, [this](const QStringList &) {
+        onThemeSettingsChanged();
+    });
+}
+
+VexWidget::~VexWidget() {
+    saveSettings();
+}
+
+void VexWidget::onThemeSettingsChanged() {
+    for (int i = 0; i < tabWidget->count(); ++i) {
+        VexEditor *editor = qobject_cast<VexEditor*>(tabWidget->widget(i));
+        if (editor) {
+            editor->viewport()->update();
+            editor->highlightCurrentLine();
+        }
+    }
+}
+
+
+
+void VexWidget::saveToolbarState() {
+    if (m_mainWindow) {
+        Settings::instance().setValue("toolbarState", m_mainWindow->saveState());
+    }
+}
+
+void VexWidget::restoreToolbarState() {
+    if (m_mainWindow) {
+        QByteArray state = Settings::instance().get<QByteArray>("toolbarState");
+        if (!state.isEmpty()) {
+            m_mainWindow->restoreState(state);
+        }
+    }
+}
+
+void VexWidget::saveSessionAndQuit() {
+    // materializeRestore() takes entries out of the hash, so walk a copy of the keys
+    const QList<VexEditor*> editors = m_pendingRestore.keys();
+    for (VexEditor *pending : editors) {
+        if (m_pendingRestore.value(pending).decoded) {
+            materializeRestore(pending);
+        }
+    }
+
+    QStringList legacyLeft;
+    for (const PendingRestore &pending : std::as_const(m_pendingRestore)) {
+        if (pending.kind == PendingRestore::Legacy) legacyLeft.append(pending.source);
+    }
+    if (!legacyLeft.isEmpty()) {
+        Settings::instance().setValue("sessionFiles", legacyLeft);
+        Settings::instance().setValue("hasSavedSession", true);
+    }
+
+    for (int i = 0; i < tabWidget->count(); ++i) {
+        VexEditor *editor = qobject_cast<VexEditor*>(tabWidget->widget(i));
+        if (editor && editor->document()->isModified()) {
+            editor->journal()->flush();
+        }
+    }
+    saveWorkspace();
+    JournalWriter::instance()->drain();
+
+    saveToolbarState();
+    saveSettings();
+    qApp->quit();
+}
+
+void VexWidget::loadSavedSession() {
+    m_restoreClock.start();
+    m_restoreStart = StartupTrace::instance().now();
+    Settings &settings = Settings::instance();
+    QStringList sessionFiles;
+    if (settings.get<bool>("hasSavedSession", false)) {
+        sessionFiles = settings.get<QStringList>("sessionFiles");
+    }
+    settings.remove("sessionFiles");
+    settings.remove("hasSavedSession");
+
+    WorkspaceSession::State workspace;
+    WorkspaceSession::load(workspace);
+    m_workspaceReady = true;
+
+    QStringList journals = AutosaveJournal::orphans();
+    bool restoreBackups = false;
+    if (!sessionFiles.isEmpty() || !journals.isEmpty()) {
+        QMessageBox::StandardButton reply = QMessageBox::question(
+            this, "Restore Previous Session",
+            "A previous session with unsaved changes was found.\n\n"
+            "Would you like to restore these files?",
+            QMessageBox::Yes | QMessageBox::No,
+            QMessageBox::Yes
+            );
+        restoreBackups = reply == QMessageBox::Yes;
+    }
+
+    if (!restoreBackups) {
+        for (const QString &sessionPath : std::as_const(sessionFiles)) {
+            QFile::remove(sessionPath);
+        }
+        for (const QString &journalPath : std::as_const(journals)) {
+            JournalWriter::instance()->remove(journalPath);
+        }
+        sessionFiles.clear();
+        journals.clear();
+    }
+
+    const QStringList whitelist = settings.get<QStringList>("binaryWhitelist", QStringList());
+    auto schedule = [this, &whitelist](PendingRestore::Kind kind, const QString &source,
+                                       const WorkspaceSession::Tab &view) {
+        VexEditor *editor = addRestorePlaceholder(view);
+        PendingRestore pending;
+        pending.kind = kind;
+        pending.source = source;
+        pending.view = view;
+        m_pendingRestore.insert(editor, pending);
+        ++m_restoreOutstanding;
+
+        const bool whitelisted = whitelist.contains(source);
+        QThreadPool::globalInstance()->start([this, editor, kind, source, whitelisted]() {
+            AutosaveJournal::Recovered recovered;
+            bool ok = false;
+            switch (kind) {
+            case PendingRestore::Legacy:  ok = readLegacySession(source, recovered); break;
+            case PendingRestore::Journal: ok = AutosaveJournal::replay(source, recovered); break;
+            case PendingRestore::File:    ok = readTextFile(source, whitelisted, recovered); break;
+            }
+            QMetaObject::invokeMethod(this, [this, editor, recovered, ok]() {
+                onRestoreDecoded(editor, recovered, ok);
+            }, Qt::QueuedConnection);
+        });
+        return editor;
+    };
+
+    VexEditor *current = nullptr;
+    for (qsizetype i = 0; i < workspace.tabs.size(); ++i) {
+        const WorkspaceSession::Tab &tab = workspace.tabs.at(i);
+        VexEditor *editor = nullptr;
+        qsizetype journal = -1;
+        for (qsizetype j = 0; !tab.journal.isEmpty() && j < journals.size(); ++j) {
+            if (QFileInfo(journals.at(j)).fileName() == QFileInfo(tab.journal).fileName()) {
+                journal = j;
+                break;
+            }
+        }
+        if (journal != -1) {
+            editor = schedule(PendingRestore::Journal, journals.takeAt(journal), tab);
+        } else if (!tab.path.isEmpty() && QFileInfo(tab.path).isFile()
+                   && !filePaths.values().contains(tab.path)) {
+            editor = schedule(PendingRestore::File, tab.path, tab);
+        }
+        if (editor && i == workspace.current) current = editor;
+    }
+    for (const QString &sessionPath : std::as_const(sessionFiles)) {
+        schedule(PendingRestore::Legacy, sessionPath, WorkspaceSession::Tab());
+    }
+    for (const QString &journalPath : std::as_const(journals)) {
+        schedule(PendingRestore::Journal, journalPath, WorkspaceSession::Tab());
+    }
+    if (m_pendingRestore.isEmpty()) {
+        finishSessionRestore();
+        return;
+    }
+    if (current) tabWidget->setCurrentWidget(current);
+
+    StartupTrace &trace = StartupTrace::instance();
+    trace.record(QString("session placeholders (%1 tabs)").arg(m_pendingRestore.size()), "session",
+                 m_restoreStart, trace.now() - m_restoreStart);
+
+    updateWindowTitle(m_mainWindow);
+    onTabCountChanged(tabWidget->count());
+}
+
+bool VexWidget::readLegacySession(const QString &path, AutosaveJournal::Recovered &recovered) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return false;
+
+    QTextStream in(&file);
+    in.setEncoding(QStringConverter::Utf8);
+    recovered.originalPath = in.readLine();
+    recovered.content = in.readAll();
+    recovered.lineEnding = LineEnding::LF;
+    return true;
+}
+
+bool VexWidget::readTextFile(const QString &path, bool whitelisted, AutosaveJournal::Recovered &recovered) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    QByteArray data = file.readAll();
+    if (!whitelisted && hasBinaryContent(data)) return false;
+
+    LineEnding::Type type = LineEnding::detect(data);
+    recovered.originalPath = path;
+    recovered.lineEnding = type;
+    recovered.content = LineEnding(type).decode(data);
+    return true;
+}
+
+VexEditor* VexWidget::addRestorePlaceholder(const WorkspaceSession::Tab &view) {
+    VexEditor *editor = createEditor();
+    editor->setReadOnly(true);
+    if (!view.syntax.isEmpty()) {
+        editor->setProperty("vexSyntax", view.syntax);
     }
-    connect(m_settingsWatcher, &QFileSystemWatcher::fileChanged, this, &VexWidget::onSettingsFileChanged);
+
+    QString tabName = view.path.isEmpty() ? "Restoring..." : QFileInfo(view.path).fileName();
+    tabWidget->addTab(editor, tabName);
+    filePaths[editor] = QString();
+    editorLineEndings[editor] = LineEnding::LF;
+    return editor;
 }
 
-VexWidget::~VexWidget() {
-    saveSettings();
-}
+void VexWidget::onRestoreDecoded(VexEditor *editor, const AutosaveJournal::Recovered &recovered, bool ok) {
+    auto it = m_pendingRestore.find(editor);
+    if (it == m_pendingRestore.end()) return;
 
-void VexWidget::onSettingsFileChanged(const QString &path) {
-    if (!m_settingsWatcher->files().contains(path)) {
-        m_settingsWatcher->addPath(path);
-    }
-    for (int i = 0; i < tabWidget->count(); ++i) {
-        VexEditor *editor = qobject_cast<VexEditor*>(tabWidget->widget(i));
-        if (editor) {
-            editor->viewport()->update();
-            editor->highlightCurrentLine();
+    int index = tabWidget->indexOf(editor);
+    if (!ok) {
+        if (it->kind == PendingRestore::Journal) JournalWriter::instance()->remove(it->source);
+        m_pendingRestore.erase(it);
+        if (index != -1) tabWidget->removeTab(index);
+    } else {
+        it->data = recovered;
+        it->decoded = true;
+        if (index != -1 && it->kind != PendingRestore::File) {
+            tabWidget->setTabText(index, recovered.originalPath.isEmpty() ? "Restored (Unsaved)" :
+                                             QFileInfo(recovered.originalPath).fileName() + " (Recovered)");
+        }
+        if (tabWidget->currentWidget() == editor) {
+            materializeRestore(editor);
         }
     }
-    if (m_mainWindow) {
-        m_mainWindow->statusBar()->showMessage("saved.", 100);
+
+    if (--m_restoreOutstanding == 0) {
+        StartupTrace &trace = StartupTrace::instance();
+        trace.record("session backups decoded", "session", m_restoreStart, trace.now() - m_restoreStart);
+        m_idleRestoreTimer->start();
     }
+    onTabCountChanged(tabWidget->count());
 }
 
+void VexWidget::materializeRestore(VexEditor *editor) {
+    PendingRestore pending = m_pendingRestore.take(editor);
+    const LineEnding::Type type = static_cast<LineEnding::Type>(pending.data.lineEnding);
+    const bool recovered = pending.kind != PendingRestore::File;
 
+    editor->loadText(pending.data.content);
+    editor->setReadOnly(false);
+    editor->journal()->setOrigin(pending.data.originalPath, type);
+    editor->document()->setModified(recovered);
+    applyViewState(editor, pending.view);
+    editor->highlightCurrentLine();
 
-void VexWidget::saveToolbarState() {
-    if (m_mainWindow) {
-        Settings::instance().setValue("toolbarState", m_mainWindow->saveState());
+    filePaths[editor] = pending.data.originalPath;
+    editorLineEndings[editor] = type;
+    if (tabWidget->currentWidget() == editor) {
+        m_lineEnding->setType(type);
     }
-}
 
-void VexWidget::restoreToolbarState() {
-    if (m_mainWindow) {
-        QByteArray state = Settings::instance().get<QByteArray>("toolbarState");
-        if (!state.isEmpty()) {
-            m_mainWindow->restoreState(state);
+    if (pending.kind == PendingRestore::Legacy) {
+        QFile::remove(pending.source);
+    } else if (pending.kind == PendingRestore::Journal) {
+        JournalWriter::instance()->remove(pending.source);
+    } else {
+        fileWatcher->addPath(pending.source);
+    }
+
+    int index = tabWidget->indexOf(editor);
+    if (index != -1) {
+        updateTabAppearance(index);
+        if (recovered) {
+            tabWidget->setTabText(index, pending.data.originalPath.isEmpty() ? "Restored (Unsaved)" :
+                                             QFileInfo(pending.data.originalPath).fileName() + " (Recovered)");
         }
     }
+    updateWindowTitle(m_mainWindow);
+    scheduleWorkspaceSave();
 }
 
-void VexWidget::saveSessionAndQuit() {
-    QString tempDir = Settings::basePath() + "/.temp";
-    QDir().mkpath(tempDir);
-
-    QStringList sessionFiles;
-
-    for (int i = 0; i < tabWidget->count(); ++i) {
-        VexEditor *editor = qobject_cast<VexEditor*>(tabWidget->widget(i));
-        if (editor && editor->document()->isModified()) {
-            QString originalPath = filePaths.value(editor);
-            QString sessionPath = tempDir + QString("/session_%1.bak").arg(i);
-
-            QFile file(sessionPath);
-            if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-                QTextStream out(&file);
-                out.setEncoding(QStringConverter::Utf8);
-                out << (originalPath.isEmpty() ? "" : originalPath) << "\n";
-                out << editor->toPlainText();
-                file.close();
-
-                sessionFiles.append(sessionPath);
-            }
+void VexWidget::materializeNextRestore() {
+    for (auto it = m_pendingRestore.cbegin(); it != m_pendingRestore.cend(); ++it) {
+        if (it->decoded) {
+            materializeRestore(it.key());
+            return;
         }
     }
-
-    if (!sessionFiles.isEmpty()) {
-        Settings::instance().setValue("sessionFiles", sessionFiles);
-        Settings::instance().setValue("hasSavedSession", true);
+    m_idleRestoreTimer->stop();
+    if (!m_sessionRestored) {
+        if (m_mainWindow) {
+            m_mainWindow->statusBar()->showMessage(
+                QString("Session restored in %1 ms").arg(m_restoreClock.elapsed()), 3000);
+        }
+        finishSessionRestore();
     }
-
-    saveToolbarState();
-    saveSettings();
-    qApp->quit();
 }
 
-void VexWidget::loadSavedSession() {
-    Settings &settings = Settings::instance();
-    bool hasSession = settings.get<bool>("hasSavedSession", false);
-    if (!hasSession) return;
-
-    QStringList sessionFiles = settings.get<QStringList>("sessionFiles");
-    if (sessionFiles.isEmpty()) return;
-
-    QMessageBox::StandardButton reply = QMessageBox::question(
-        this, "Restore Previous Session",
-        "A previous session with unsaved changes was found.\n\n"
-        "Would you like to restore these files?",
-        QMessageBox::Yes | QMessageBox::No,
-        QMessageBox::Yes
-        );
+void VexWidget::finishSessionRestore() {
+    if (m_sessionRestored) return;
+    m_sessionRestored = true;
 
-    if (reply == QMessageBox::Yes) {
-        for (const QString &sessionPath : std::as_const(sessionFiles)) {
-            QFile file(sessionPath);
-            if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-                QTextStream in(&file);
-                in.setEncoding(QStringConverter::Utf8);
-
-                QString originalPath = in.readLine();
-                QString content = in.readAll();
-                file.close();
-
-                VexEditor *editor = new VexEditor(this);
-                editor->setupMode(modeLabel);
-                editor->setLineWrapping(lineWrapAction->isChecked());
-                editor->setPlainText(content);
-                editor->document()->setModified(true);
-
-                connect(editor, &VexEditor::modeChanged, this, [this](Mode::ModeEnum) {
-                    updateCursorPosition();
-                });
-                connect(editor, &VexEditor::saveRequested, this, &VexWidget::saveFile);
-                connect(editor, &VexEditor::vimKeyPressed, this, [this](const QString &key) {
-                    vimHintLabel->setText(key);
-                    QTimer::singleShot(800, this, [this]() { vimHintLabel->clear(); });
-                });
-                connect(editor, &VexEditor::commandLineChanged, this, [this](const QString &cmd) {
-                    vimHintLabel->setText(cmd);
-                });
-                connect(editor, &VexEditor::commandExecuted, this, [this](const QString &cmd, bool success) {
-                    QString msg = success ? "Success: " + cmd : "Failed: " + cmd;
-                    if (m_mainWindow) {
-                        m_mainWindow->statusBar()->showMessage(msg, 2000);
-                    }
-                    vimHintLabel->clear();
-                });
-                connect(editor, &QPlainTextEdit::cursorPositionChanged, this, &VexWidget::updateCursorPosition);
-                connect(editor->document(), &QTextDocument::modificationChanged, this, [this, editor](bool) {
-                    int index = tabWidget->indexOf(editor);
-                    if (index != -1) {
-                        updateTabAppearance(index);
-                    }
-                });
-
-                QString tabName = originalPath.isEmpty() ? "Restored (Unsaved)" :
-                                      QFileInfo(originalPath).fileName() + " (Recovered)";
-                int index = tabWidget->addTab(editor, tabName);
-                tabWidget->setCurrentIndex(index);
-                filePaths[editor] = originalPath;
-                editorLineEndings[editor] = LineEnding::LF;
-                updateTabAppearance(index);
-            }
-            QFile::remove(sessionPath);
-        }
-    } else {
-        for (const QString &sessionPath : std::as_const(sessionFiles)) {
-            QFile::remove(sessionPath);
+    StartupTrace &trace = StartupTrace::instance();
+    trace.record("session restore", "session", m_restoreStart, trace.now() - m_restoreStart);
+    trace.release();
+}
+
+void VexWidget::dropPendingRestores() {
+    for (auto it = m_pendingRestore.begin(); it != m_pendingRestore.end(); ++it) {
+        if (it->kind == PendingRestore::Legacy) {
+            QFile::remove(it->source);
+        } else if (it->kind == PendingRestore::Journal) {
+            JournalWriter::instance()->remove(it->source);
+            it->view.journal.clear();
         }
     }
+}
 
-    settings.remove("sessionFiles");
-    settings.remove("hasSavedSession");
+void VexWidget::applyViewState(VexEditor *editor, const WorkspaceSession::Tab &view) {
+    const int last = editor->document()->characterCount() - 1;
+    QTextCursor cursor(editor->document());
+    cursor.setPosition(qBound(0, int(view.anchor), last));
+    cursor.setPosition(qBound(0, int(view.position), last), QTextCursor::KeepAnchor);
+    editor->setTextCursor(cursor);
+
+    const int vscroll = view.vscroll;
+    const int hscroll = view.hscroll;
+    QTimer::singleShot(0, editor, [editor, vscroll, hscroll]() {
+        editor->verticalScrollBar()->setValue(vscroll);
+        editor->horizontalScrollBar()->setValue(hscroll);
+    });
+}
 
-    updateWindowTitle(m_mainWindow);
-    onTabCountChanged(tabWidget->count());
+void VexWidget::trackWorkspace(VexEditor *editor) {
+    connect(editor, &QPlainTextEdit::cursorPositionChanged, this, &VexWidget::scheduleWorkspaceSave);
+    connect(editor->verticalScrollBar(), &QScrollBar::valueChanged, this, &VexWidget::scheduleWorkspaceSave);
+    connect(editor->horizontalScrollBar(), &QScrollBar::valueChanged, this, &VexWidget::scheduleWorkspaceSave);
+    connect(editor->document(), &QTextDocument::modificationChanged, this, &VexWidget::scheduleWorkspaceSave);
 }
 
-void VexWidget::handleInstanceRequest(const QString &requestFilePath) {
-    QFile file(requestFilePath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        return;
-    }
+void VexWidget::scheduleWorkspaceSave() {
+    if (m_workspaceReady && !m_workspaceTimer->isActive())
+        m_workspaceTimer->start();
+}
 
-    QTextStream in(&file);
-    in.setEncoding(QStringConverter::Utf8);
-    QStringList pathsToOpen;
+void VexWidget::saveWorkspace() {
+    m_workspaceTimer->stop();
+    if (!m_workspaceReady) return;
+    JournalWriter::instance()->replace(WorkspaceSession::filePath(),
+                                       WorkspaceSession::encode(captureWorkspace()));
+}
 
-    while (!in.atEnd()) {
-        QString path = in.readLine().trimmed();
-        if (!path.isEmpty()) {
-            pathsToOpen.append(path);
+WorkspaceSession::State VexWidget::captureWorkspace() const {
+    WorkspaceSession::State state;
+    for (int i = 0; i < tabWidget->count(); ++i) {
+        VexEditor *editor = qobject_cast<VexEditor*>(tabWidget->widget(i));
+        if (!editor) continue;
+
+        WorkspaceSession::Tab tab;
+        auto pending = m_pendingRestore.constFind(editor);
+        if (pending != m_pendingRestore.cend()) {
+            if (pending->kind == PendingRestore::Legacy) continue;
+            tab = pending->view;
+            if (pending->kind == PendingRestore::File) tab.path = pending->source;
+        } else {
+            QTextCursor cursor = editor->textCursor();
+            tab.path       = filePaths.value(editor);
+            tab.journal    = editor->journal()->isActive() ? editor->journal()->fileName() : QString();
+            tab.lineEnding = editorLineEndings.value(editor, LineEnding::LF);
+            tab.syntax     = editor->property("vexSyntax").toString();
+            tab.anchor     = cursor.anchor();
+            tab.position   = cursor.position();
+            tab.vscroll    = editor->verticalScrollBar()->value();
+            tab.hscroll    = editor->horizontalScrollBar()->value();
         }
-    }
-    file.close();
+        if (tab.path.isEmpty() && tab.journal.isEmpty()) continue;
 
-    QFile clearFile(requestFilePath);
-    if (clearFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        clearFile.close();
+        if (i == tabWidget->currentIndex()) state.current = state.tabs.size();
+        state.tabs.append(tab);
     }
+    return state;
+}
 
-    for (const QString &path : pathsToOpen) {
-        if (QFileInfo::exists(path)) {
-            openFileAtPath(path);
-        } else if (m_mainWindow) {
-            m_mainWindow->statusBar()->showMessage(tr("Invalid file path: %1").arg(path), 2000);
-        }
-    }
+void VexWidget::gotoLine(int line) {
+    VexEditor *editor = getCurrentEditor();
+    if (!editor || line < 1) return;
 
-    if (m_mainWindow && !pathsToOpen.isEmpty()) {
-        m_mainWindow->raise();
-        m_mainWindow->activateWindow();
-    }
+    QTextBlock block = editor->document()->findBlockByNumber(qMin(line, editor->document()->blockCount()) - 1);
+    QTextCursor cursor(block);
+    editor->setTextCursor(cursor);
+    editor->centerCursor();
 }
 
 void VexWidget::setupUI(QMainWindow *mainWin) {
@@ -1218,11 +4122,15 @@ void VexWidget::setupUI(QMainWindow *mainWin) {
     layout->addWidget(stackedWidget);
 
     connect(tabWidget, &QTabWidget::tabCloseRequested, this, &VexWidget::closeTab);
+    connect(tabWidget->tabBar(), &QTabBar::tabMoved, this, &VexWidget::scheduleWorkspaceSave);
     connect(tabWidget, &QTabWidget::currentChanged, [this, mainWin](int) {
         updateWindowTitle(mainWin);
         onTabCountChanged(tabWidget->count());
         VexEditor *editor = getCurrentEditor();
         if (editor) {
+            if (m_pendingRestore.value(editor).decoded) {
+                materializeRestore(editor);
+            }
             LineEnding::Type type = editorLineEndings.value(editor, LineEnding::LF);
             m_lineEnding->setType(type);
         }
@@ -1244,6 +4152,10 @@ void VexWidget::setupUI(QMainWindow *mainWin) {
     vimHintLabel = new QLabel("", mainWin);
     vimHintLabel->setStyleSheet("QLabel { font-family: monospace; }");
     mainWin->statusBar()->addPermanentWidget(vimHintLabel);
+    vimHintTimer = new QTimer(this);
+    vimHintTimer->setSingleShot(true);
+    vimHintTimer->setInterval(800);
+    connect(vimHintTimer, &QTimer::timeout, this, [this]() { showVimHint(QString(), false); });
 
     QTimer::singleShot(0, this, &VexWidget::restoreToolbarState);
 }
@@ -1345,36 +4257,7 @@ void VexWidget::setupToolbar(QMainWindow *mainWin) {
 }
 
 void VexWidget::newFile() {
-    VexEditor *editor = new VexEditor(this);
-    editor->setupMode(modeLabel);
-    editor->setLineWrapping(lineWrapAction->isChecked());
-
-    connect(editor, &VexEditor::modeChanged, this, [this](Mode::ModeEnum) {
-        updateCursorPosition();
-    });
-    connect(editor, &VexEditor::saveRequested, this, &VexWidget::saveFile);
-    connect(editor, &VexEditor::vimKeyPressed, this, [this](const QString &key) {
-        vimHintLabel->setText(key);
-        QTimer::singleShot(800, this, [this]() { vimHintLabel->clear(); });
-    });
-    connect(editor, &VexEditor::commandLineChanged, this, [this](const QString &cmd) {
-        vimHintLabel->setText(cmd);
-    });
-    connect(editor, &VexEditor::commandExecuted, this, [this](const QString &cmd, bool success) {
-        QString msg = success ? "Success: " + cmd : "Failed: " + cmd;
-        if (m_mainWindow) {
-            m_mainWindow->statusBar()->showMessage(msg, 2000);
-        }
-        vimHintLabel->clear();
-    });
-    connect(editor, &QPlainTextEdit::cursorPositionChanged, this, &VexWidget::updateCursorPosition);
-    connect(editor->document(), &QTextDocument::modificationChanged, this, [this, editor](bool) {
-        int index = tabWidget->indexOf(editor);
-        if (index != -1) {
-            updateTabAppearance(index);
-        }
-    });
-
+    VexEditor *editor = createEditor();
     int index = tabWidget->addTab(editor, "No Name");
     tabWidget->setCurrentIndex(index);
     filePaths[editor] = QString();
@@ -1457,60 +4340,166 @@ void VexWidget::openFileAtPath(const QString &filePath) {
     LineEnding converter(detectedType);
     QString content = converter.decode(data);
 
+    VexEditor *editor = addFileTab(filePath, content, detectedType);
+    tabWidget->setCurrentWidget(editor);
+    m_lineEnding->setType(detectedType);
+    updateWindowTitle(m_mainWindow);
+
+    addRecentFiles(QStringList() << filePath);
+    if (m_mainWindow) {
+        m_mainWindow->statusBar()->showMessage("Opened: " + filePath, 2000);
+    }
+    onTabCountChanged(tabWidget->count());
+}
+
+void VexWidget::openFiles(const QStringList &paths, int line) {
+    if (paths.isEmpty()) return;
+
+    QSharedPointer<OpenBatch> batch(new OpenBatch);
+    batch->clock.start();
+    batch->line = line;
+    batch->editors.resize(paths.size());
+
+    const QStringList whitelist = Settings::instance().get<QStringList>("binaryWhitelist", QStringList());
+    for (qsizetype i = 0; i < paths.size(); ++i) {
+        const QString path = QDir::current().absoluteFilePath(paths.at(i));
+        batch->paths.append(path);
+
+        QFileInfo info(path);
+        if (!info.isFile() || !info.isReadable()) {
+            batch->deferred.append(path);
+            continue;
+        }
+
+        ++batch->remaining;
+        const bool whitelisted = whitelist.contains(path);
+        QThreadPool::globalInstance()->start([this, batch, i, path, whitelisted]() {
+            AutosaveJournal::Recovered decoded;
+            bool ok = readTextFile(path, whitelisted, decoded);
+            QMetaObject::invokeMethod(this, [this, batch, i, decoded, ok]() {
+                onBatchFileDecoded(batch, i, decoded, ok);
+            }, Qt::QueuedConnection);
+        });
+    }
+
+    if (batch->remaining == 0) finishOpenBatch(batch);
+}
+
+void VexWidget::onBatchFileDecoded(const QSharedPointer<OpenBatch> &batch, qsizetype ordinal,
+                                   const AutosaveJournal::Recovered &decoded, bool ok) {
+    if (ok) {
+        int position = -1;
+        for (qsizetype j = ordinal + 1; j < batch->editors.size(); ++j) {
+            if (batch->editors.at(j)) {
+                position = tabWidget->indexOf(batch->editors.at(j));
+                break;
+            }
+        }
+        batch->editors[ordinal] = addFileTab(decoded.originalPath, decoded.content,
+                                             static_cast<LineEnding::Type>(decoded.lineEnding), position);
+    } else {
+        batch->deferred.append(batch->paths.at(ordinal));
+    }
+
+    if (--batch->remaining == 0) finishOpenBatch(batch);
+}
+
+void VexWidget::finishOpenBatch(const QSharedPointer<OpenBatch> &batch) {
+    QStringList opened;
+    VexEditor *last = nullptr;
+    for (qsizetype i = 0; i < batch->editors.size(); ++i) {
+        if (batch->editors.at(i)) {
+            opened.append(batch->paths.at(i));
+            last = batch->editors.at(i);
+        }
+    }
+
+    if (last) {
+        tabWidget->setCurrentWidget(last);
+        m_lineEnding->setType(editorLineEndings.value(last, LineEnding::LF));
+        gotoLine(batch->line);
+        addRecentFiles(opened);
+        updateWindowTitle(m_mainWindow);
+        onTabCountChanged(tabWidget->count());
+        if (m_mainWindow) {
+            m_mainWindow->statusBar()->showMessage(
+                QString("Opened %1 file(s) in %2 ms").arg(opened.size()).arg(batch->clock.elapsed()), 2000);
+        }
+    }
+
+    for (const QString &path : std::as_const(batch->deferred)) {
+        openFileAtPath(path);
+    }
+}
+
+VexEditor* VexWidget::createEditor() {
+    if (QObject *host = qApp->findChild<QObject*>("VexPluginHost", Qt::FindDirectChildrenOnly)) {
+        host->setProperty("editors", true);
+    }
     VexEditor *editor = new VexEditor(this);
     editor->setupMode(modeLabel);
     editor->setLineWrapping(lineWrapAction->isChecked());
-    editor->setPlainText(content);
 
     connect(editor, &VexEditor::modeChanged, this, [this](Mode::ModeEnum) {
-        updateCursorPosition();
+        scheduleCursorPosition();
     });
     connect(editor, &VexEditor::saveRequested, this, &VexWidget::saveFile);
+    connect(editor, &VexEditor::quitRequested, this, [this, editor](bool force) {
+        int index = tabWidget->indexOf(editor);
+        if (index == -1) return;
+        if (force) {
+            editor->document()->setModified(false);
+            editor->journal()->discard();
+        }
+        closeTab(index);
+    }, Qt::QueuedConnection);
     connect(editor, &VexEditor::vimKeyPressed, this, [this](const QString &key) {
-        vimHintLabel->setText(key);
-        QTimer::singleShot(800, this, [this]() { vimHintLabel->clear(); });
+        showVimHint(key, true);
     });
     connect(editor, &VexEditor::commandLineChanged, this, [this](const QString &cmd) {
-        vimHintLabel->setText(cmd);
+        showVimHint(cmd, false);
     });
     connect(editor, &VexEditor::commandExecuted, this, [this](const QString &cmd, bool success) {
         QString msg = success ? "Success: " + cmd : "Failed: " + cmd;
         if (m_mainWindow) {
             m_mainWindow->statusBar()->showMessage(msg, 2000);
         }
-        vimHintLabel->clear();
+        showVimHint(QString(), false);
     });
-    connect(editor, &QPlainTextEdit::cursorPositionChanged, this, &VexWidget::updateCursorPosition);
+    connect(editor, &QPlainTextEdit::cursorPositionChanged, this, &VexWidget::scheduleCursorPosition);
     connect(editor->document(), &QTextDocument::modificationChanged, this, [this, editor](bool) {
-        int index = tabWidget->indexOf(editor);
-        if (index != -1) {
-            updateTabAppearance(index);
-        }
+        scheduleTabAppearance(editor);
     });
+    trackWorkspace(editor);
+    return editor;
+}
 
-    int index = tabWidget->addTab(editor, QFileInfo(filePath).fileName());
-    tabWidget->setCurrentIndex(index);
+VexEditor* VexWidget::addFileTab(const QString &filePath, const QString &content,
+                                 LineEnding::Type type, int position) {
+    VexEditor *editor = createEditor();
+    editor->loadText(content);
+
+    int index = tabWidget->insertTab(position, editor, QFileInfo(filePath).fileName());
     filePaths[editor] = filePath;
-    editorLineEndings[editor] = detectedType;
-    if (tabWidget->currentWidget() == editor) {
-        m_lineEnding->setType(detectedType);
-    }
+    editorLineEndings[editor] = type;
+    editor->journal()->setOrigin(filePath, type);
     updateTabAppearance(index);
-    updateWindowTitle(m_mainWindow);
     fileWatcher->addPath(filePath);
+    return editor;
+}
 
+void VexWidget::addRecentFiles(const QStringList &paths) {
+    Settings &settings = Settings::instance();
     QStringList recentFiles = settings.get<QStringList>("recentFiles");
-    recentFiles.removeAll(filePath);
-    recentFiles.prepend(filePath);
+    for (const QString &path : paths) {
+        recentFiles.removeAll(path);
+        recentFiles.prepend(path);
+    }
     while (recentFiles.size() > MAX_RECENT_FILES) {
         recentFiles.removeLast();
     }
     settings.setValue("recentFiles", recentFiles);
     updateRecentMenu();
-    if (m_mainWindow) {
-        m_mainWindow->statusBar()->showMessage("Opened: " + filePath, 2000);
-    }
-    onTabCountChanged(tabWidget->count());
 }
 void VexWidget::openFileByName() {
     QDialog dialog(this);
@@ -1677,24 +4666,14 @@ void VexWidget::saveFile() {
     if (file.open(QIODevice::WriteOnly)) {
         LineEnding::Type type = editorLineEndings.value(editor, LineEnding::LF);
         LineEnding converter(type);
-        QByteArray encoded = converter.encode(editor->toPlainText());
-        file.write(encoded);
-        if (file.commit()) {
+        if (converter.encodeTo(&file, editor->snapshot()) && file.commit()) {
             editor->document()->setModified(false);
             updateTabAppearance(tabWidget->currentIndex());
             if (m_mainWindow) {
                 m_mainWindow->statusBar()->showMessage("File saved: " + fileName, 3000);
             }
 
-            Settings &settings = Settings::instance();
-            QStringList recentFiles = settings.get<QStringList>("recentFiles");
-            recentFiles.removeAll(fileName);
-            recentFiles.prepend(fileName);
-            while (recentFiles.size() > MAX_RECENT_FILES) {
-                recentFiles.removeLast();
-            }
-            settings.setValue("recentFiles", recentFiles);
-            updateRecentMenu();
+            addRecentFiles(QStringList() << fileName);
             return;
         }
     }
@@ -1711,7 +4690,7 @@ void VexWidget::saveFile() {
         if (reply == QMessageBox::Yes) {
             LineEnding::Type type = editorLineEndings.value(editor, LineEnding::LF);
             LineEnding converter(type);
-            QByteArray encoded = converter.encode(editor->toPlainText());
+            QByteArray encoded = converter.encode(editor->snapshot());
             QString content = QString::fromUtf8(encoded);
             if (adminHandler.saveWithAdmin(fileName, content)) {
                 editor->document()->setModified(false);
@@ -1733,8 +4712,10 @@ void VexWidget::saveFileAs() {
     QString fileName = QFileDialog::getSaveFileName(this, "Save File", QString(), "All Files (*)");
     if (!fileName.isEmpty()) {
         filePaths[editor] = fileName;
+        editor->journal()->setOrigin(fileName, editorLineEndings.value(editor, LineEnding::LF));
         updateTabAppearance(tabWidget->currentIndex());
         saveFile();
+        scheduleWorkspaceSave();
     }
 }
 
@@ -1748,6 +4729,15 @@ bool VexWidget::eventFilter(QObject *obj, QEvent *event) {
 
 void VexWidget::closeTab(int index) {
     VexEditor *editor = qobject_cast<VexEditor*>(tabWidget->widget(index));
+    if (editor && m_pendingRestore.contains(editor)) {
+        if (!m_pendingRestore.value(editor).decoded) {
+            if (m_mainWindow) {
+                m_mainWindow->statusBar()->showMessage("Still restoring this tab...", 2000);
+            }
+            return;
+        }
+        materializeRestore(editor);
+    }
     if (editor && editor->document()->isModified()) {
         QMessageBox::StandardButton reply = QMessageBox::question(
             this, "Unsaved Changes",
@@ -1758,6 +4748,8 @@ void VexWidget::closeTab(int index) {
             saveFile();
         } else if (reply == QMessageBox::Cancel) {
             return;
+        } else {
+            editor->journal()->discard();
         }
     }
 
@@ -1797,10 +4789,36 @@ void VexWidget::updateCursorPosition() {
         QTextCursor cursor = editor->textCursor();
         int line = cursor.blockNumber() + 1;
         int col  = cursor.columnNumber() + 1;
-        positionLabel->setText(QString("Line: %1, Col: %2").arg(line).arg(col));
+        const QString text = QString("Line: %1, Col: %2").arg(line).arg(col);
+        if (positionLabel->text() != text) positionLabel->setText(text);
     }
 }
 
+void VexWidget::scheduleCursorPosition() {
+    FrameScheduler::instance()->schedule(this, FrameScheduler::CursorPosition, [this]() { updateCursorPosition(); });
+}
+
+void VexWidget::scheduleTabAppearance(VexEditor *editor) {
+    FrameScheduler::instance()->schedule(editor, FrameScheduler::TabAppearance, [this, editor]() {
+        int index = tabWidget->indexOf(editor);
+        if (index != -1) {
+            updateTabAppearance(index);
+        }
+    });
+}
+
+// Transient hints (pending vi keys) clear themselves after the hint timeout
+void VexWidget::showVimHint(const QString &text, bool transient) {
+    m_vimHint = text;
+    if (transient)
+        vimHintTimer->start();
+    else
+        vimHintTimer->stop();
+    FrameScheduler::instance()->schedule(this, FrameScheduler::VimHint, [this]() {
+        if (vimHintLabel->text() != m_vimHint) vimHintLabel->setText(m_vimHint);
+    });
+}
+
 void VexWidget::showFindReplaceDialog() {
     if (!findDialog) {
         findDialog = new FindReplaceDialog(this);
@@ -2096,19 +5114,23 @@ void VexWidget::dragMoveEvent(QDragMoveEvent *event) {
 
 void VexWidget::dropEvent(QDropEvent *event) {
     const QList<QUrl> urls = event->mimeData()->urls();
+    QStringList paths;
     for (const QUrl &url : std::as_const(urls)) {
         QString path = url.toLocalFile();
         if (QFileInfo(path).isFile()) {
-            openFileAtPath(path);
+            paths.append(path);
         }
     }
+    openFiles(paths);
     event->acceptProposedAction();
 }
 
 void VexWidget::closeEvent(QCloseEvent *event) {
     QString tempDir = Settings::basePath() + "/.temp/";
-    QString requestFile = tempDir + QString::number(QCoreApplication::applicationPid()) + ".Req";
     bool hasUnsavedChanges = false;
+    for (const PendingRestore &pending : std::as_const(m_pendingRestore)) {
+        if (pending.kind != PendingRestore::File) hasUnsavedChanges = true;
+    }
     for (int i = 0; i < tabWidget->count(); ++i) {
         VexEditor *editor = qobject_cast<VexEditor*>(tabWidget->widget(i));
         if (editor && editor->document()->isModified()) {
@@ -2132,15 +5154,21 @@ void VexWidget::closeEvent(QCloseEvent *event) {
 
         if (msgBox.clickedButton() == saveSessionButton) {
             saveSessionAndQuit();
-            if (QFile::exists(requestFile)) QFile::remove(requestFile);
             QDir dir(tempDir);
             if (dir.exists() && dir.entryList(QDir::NoDotAndDotDot | QDir::AllEntries).isEmpty())
                 dir.rmdir(tempDir);
             event->accept();
         } else if (msgBox.clickedButton() == dontSaveButton) {
+            dropPendingRestores();
+            for (int i = 0; i < tabWidget->count(); ++i) {
+                if (VexEditor *editor = qobject_cast<VexEditor*>(tabWidget->widget(i))) {
+                    editor->journal()->discard();
+                }
+            }
+            saveWorkspace();
+            JournalWriter::instance()->drain();
             saveToolbarState();
             saveSettings();
-            if (QFile::exists(requestFile)) QFile::remove(requestFile);
             QDir dir(tempDir);
             if (dir.exists() && dir.entryList(QDir::NoDotAndDotDot | QDir::AllEntries).isEmpty())
                 dir.rmdir(tempDir);
@@ -2149,9 +5177,10 @@ void VexWidget::closeEvent(QCloseEvent *event) {
             event->ignore();
         }
     } else {
+        saveWorkspace();
+        JournalWriter::instance()->drain();
         saveToolbarState();
         saveSettings();
-        if (QFile::exists(requestFile)) QFile::remove(requestFile);
         QDir dir(tempDir);
         if (dir.exists() && dir.entryList(QDir::NoDotAndDotDot | QDir::AllEntries).isEmpty())
             dir.rmdir(tempDir);
@@ -2176,6 +5205,7 @@ void VexWidget::updateWindowTitle(QMainWindow *mainWin) {
 }
 
 void VexWidget::loadSettings() {
+    StartupTrace::Scope scope("VexWidget::loadSettings", "settings");
     VColors::initDefaults();
     Settings &settings = Settings::instance();
 
@@ -2184,6 +5214,7 @@ void VexWidget::loadSettings() {
 
     updateRecentMenu();
 
+    StartupTrace::instance().hold();
     QTimer::singleShot(100, this, &VexWidget::loadSavedSession);
 }
 
@@ -2220,29 +5251,45 @@ void VexWidget::updateTabAppearance(int tabIndex) {
     if (!editor) return;
 
     QString filePath = filePaths.value(editor);
-    QFileIconProvider iconProvider;
-    QIcon fileIcon;
-
-    if (filePath.isEmpty()) {
-        fileIcon = iconProvider.icon(QFileIconProvider::File);
-        tabWidget->setTabText(tabIndex, "Untitled");
-        tabWidget->setTabToolTip(tabIndex, "Untitled");
-    } else {
+    QString text = "Untitled";
+    QString toolTip = "Untitled";
+    if (!filePath.isEmpty()) {
         QFileInfo info(filePath);
-        fileIcon = iconProvider.icon(info);
-        tabWidget->setTabText(tabIndex, info.fileName());
-        tabWidget->setTabToolTip(tabIndex, info.absoluteFilePath());
+        text = info.fileName();
+        toolTip = info.absoluteFilePath();
     }
+    if (tabWidget->tabText(tabIndex) != text) tabWidget->setTabText(tabIndex, text);
+    if (tabWidget->tabToolTip(tabIndex) != toolTip) tabWidget->setTabToolTip(tabIndex, toolTip);
 
-    bool isModified = editor->document()->isModified();
-    if (isModified) {
-        tabWidget->setTabIcon(tabIndex, QIcon(fileIcon.pixmap(16, 16, QIcon::Disabled)));
-    } else {
-        tabWidget->setTabIcon(tabIndex, fileIcon);
+    const QPair<QIcon, QIcon> &icons = tabIcons(filePath);
+    const QIcon &icon = editor->document()->isModified() ? icons.second : icons.first;
+    if (tabWidget->tabIcon(tabIndex).cacheKey() != icon.cacheKey()) {
+        tabWidget->setTabIcon(tabIndex, icon);
+    }
+}
+
+// Normal and modified tab icons per file type; only the first file of a type
+// hits the icon provider, later tabs and modified toggles reuse the pair.
+const QPair<QIcon, QIcon> &VexWidget::tabIcons(const QString &filePath) {
+    const QFileInfo info(filePath);
+    QString type;
+    if (!filePath.isEmpty()) {
+        type = info.suffix().isEmpty() ? "name:" + info.fileName() : info.suffix().toLower();
     }
+    const QString key = QIcon::themeName() + '\n' + type;
+
+    auto it = m_tabIcons.find(key);
+    if (it == m_tabIcons.end()) {
+        QFileIconProvider iconProvider;
+        QIcon fileIcon = filePath.isEmpty() ? iconProvider.icon(QFileIconProvider::File) : iconProvider.icon(info);
+        if (fileIcon.isNull()) fileIcon = iconProvider.icon(QFileIconProvider::File);
+        QIcon modifiedIcon(fileIcon.pixmap(16, 16, QIcon::Disabled));
+        it = m_tabIcons.insert(key, qMakePair(fileIcon, modifiedIcon));
+    }
+    return it.value();
 }
 
-bool VexWidget::hasBinaryContent(const QByteArray &data) const {
+bool VexWidget::hasBinaryContent(const QByteArray &data) {
     if (data.isEmpty()) return false;
 
     int nullCount    = 0;
@@ -2290,19 +5337,146 @@ void VexWidget::onTabCountChanged(int count) {
     } else {
         stackedWidget->setCurrentIndex(1);
     }
+    scheduleWorkspaceSave();
 }
 
 void VexWidget::onLineEndingChanged() {
     VexEditor *editor = getCurrentEditor();
     if (editor) {
         editorLineEndings[editor] = m_lineEnding->type();
+        editor->journal()->setOrigin(filePaths.value(editor), m_lineEnding->type());
         editor->document()->setModified(true);
-        updateTabAppearance(tabWidget->currentIndex());
+        scheduleTabAppearance(editor);
+        scheduleWorkspaceSave();
     }
 }
+class InstanceChannel : public QObject {
+    Q_OBJECT
+public:
+    enum Command : quint8 { OpenCommand = 1, GotoCommand = 2, FocusCommand = 3 };
+
+    explicit InstanceChannel(QObject *parent = nullptr)
+        : QObject(parent)
+        , m_server(new QLocalServer(this))
+    {
+        m_server->setSocketOptions(QLocalServer::UserAccessOption);
+        connect(m_server, &QLocalServer::newConnection, this, &InstanceChannel::acceptConnections);
+    }
+
+    static QString serverName() {
+        QByteArray key = QCryptographicHash::hash(Settings::basePath().toUtf8(), QCryptographicHash::Sha1);
+        return "vex-" + QString::fromLatin1(key.toHex().left(16));
+    }
+
+    static QLocalSocket *connectToPrimary(QObject *parent) {
+        QLocalSocket *socket = new QLocalSocket(parent);
+        socket->connectToServer(serverName());
+        if (socket->waitForConnected(CONNECT_TIMEOUT)) return socket;
+        delete socket;
+        return nullptr;
+    }
+
+    static QByteArray frame(Command command, const QString &path = QString(), qint32 line = 0) {
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_6_0);
+        out << quint8(command);
+        if (command == OpenCommand) out << path << line;
+        else if (command == GotoCommand) out << line;
+
+        QByteArray message(4, Qt::Uninitialized);
+        qToBigEndian<quint32>(quint32(payload.size()), message.data());
+        return message + payload;
+    }
+
+    bool listen() {
+        if (m_server->listen(serverName())) return true;
+        if (m_server->serverError() != QAbstractSocket::AddressInUseError) return false;
+
+        QLocalSocket probe;
+        probe.connectToServer(serverName());
+        if (probe.waitForConnected(CONNECT_TIMEOUT)) return false;
+
+        QLocalServer::removeServer(serverName());
+        return m_server->listen(serverName());
+    }
+
+signals:
+    void openRequested(const QStringList &paths, int line);
+    void gotoRequested(int line);
+    void focusRequested();
+
+private slots:
+    void acceptConnections() {
+        while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+            connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+            connect(socket, &QLocalSocket::readyRead, this, [this, socket]() { readFrames(socket); });
+        }
+    }
+
+private:
+    static constexpr int     CONNECT_TIMEOUT = 200;
+    static constexpr quint32 MAX_FRAME       = 64 * 1024;
+
+    QLocalServer *m_server;
+    QHash<QLocalSocket*, QByteArray> m_buffers;
+
+    void readFrames(QLocalSocket *socket) {
+        QByteArray &buffer = m_buffers[socket];
+        if (buffer.isEmpty()) {
+            connect(socket, &QObject::destroyed, this, [this, socket]() { m_buffers.remove(socket); });
+        }
+        buffer += socket->readAll();
+
+        QStringList opened;
+        qint32 openLine = 0;
+        while (buffer.size() >= 4) {
+            const quint32 size = qFromBigEndian<quint32>(buffer.constData());
+            if (size > MAX_FRAME) {
+                flushOpened(opened, openLine);
+                socket->abort();
+                return;
+            }
+            if (quint32(buffer.size()) < 4 + size) break;
+
+            QDataStream in(buffer.mid(4, size));
+            in.setVersion(QDataStream::Qt_6_0);
+            buffer.remove(0, 4 + size);
+
+            quint8 command = 0;
+            in >> command;
+            if (command == OpenCommand) {
+                QString path;
+                qint32 line = 0;
+                in >> path >> line;
+                if (in.status() == QDataStream::Ok) {
+                    opened.append(path);
+                    if (line > 0) openLine = line;
+                }
+            } else if (command == GotoCommand) {
+                flushOpened(opened, openLine);
+                qint32 line = 0;
+                in >> line;
+                if (in.status() == QDataStream::Ok) emit gotoRequested(line);
+            } else if (command == FocusCommand) {
+                flushOpened(opened, openLine);
+                emit focusRequested();
+            }
+        }
+        flushOpened(opened, openLine);
+    }
+
+    void flushOpened(QStringList &paths, qint32 &line) {
+        if (paths.isEmpty()) return;
+        emit openRequested(paths, line);
+        paths.clear();
+        line = 0;
+    }
+};
+
 class VexCorePlugin : public QObject, public CorePlugin {
     Q_OBJECT
-    Q_PLUGIN_METADATA(IID "vex.core/4.0")
+    Q_PLUGIN_METADATA(IID "vex.core/4.0" FILE "VexCore.json")
     Q_INTERFACES(CorePlugin)
 
 public:
@@ -2316,50 +5490,30 @@ public:
         QMainWindow *mainWin = reinterpret_cast<QMainWindow*>(window);
 
         cmdLine.addCommand({{"f", "file"}, "Open file(s) at startup", ""});
-
-        QString tempDir = Settings::basePath() + "/.temp";
-        QDir().mkpath(tempDir);
-
-        qint64 currentPid = QCoreApplication::applicationPid();
-        QString requestFilePath = tempDir + "/" + QString::number(currentPid) + ".Req";
-
-        QDir dir(tempDir);
-        QStringList reqFiles = dir.entryList(QStringList() << "*.Req", QDir::Files);
-        bool otherInstanceExists = false;
-        QString targetFile;
-
-        for (const QString& file : std::as_const(reqFiles)) {
-            qint64 pid = file.section('.', 0, 0).toLongLong();
-            if (pid != currentPid && isProcessAlive(pid)) {
-                otherInstanceExists = true;
-                targetFile = tempDir + "/" + file;
-                break;
-            }
-        }
-
-        if (otherInstanceExists) {
-            QTimer::singleShot(0, [&cmdLine, targetFile]() {
-                QStringList filesToOpen = cmdLine.flagArgs("f");
-                if (!filesToOpen.isEmpty()) {
-                    QFile requestFile(targetFile);
-                    if (requestFile.open(QIODevice::Append | QIODevice::Text)) {
-                        QTextStream out(&requestFile);
-                        out.setEncoding(QStringConverter::Utf8);
-                        for (const QString& path : std::as_const(filesToOpen)) {
-                            out << QDir::current().absoluteFilePath(path) << "\n";
-                        }
-                        requestFile.close();
-                    }
+        cmdLine.addCommand({{"l", "line"}, "Jump to line in the last opened file", "line"});
+
+        if (QLocalSocket *primary = InstanceChannel::connectToPrimary(qApp)) {
+            QTimer::singleShot(0, [&cmdLine, primary]() {
+                const QStringList files = cmdLine.flagArgs("f");
+                const qint32 line = cmdLine.value("l").toInt();
+                for (qsizetype i = 0; i < files.size(); ++i) {
+                    primary->write(InstanceChannel::frame(InstanceChannel::OpenCommand,
+                                                          QDir::current().absoluteFilePath(files.at(i)),
+                                                          i == files.size() - 1 ? line : 0));
+                }
+                if (files.isEmpty() && line > 0) {
+                    primary->write(InstanceChannel::frame(InstanceChannel::GotoCommand, QString(), line));
                 }
+                primary->write(InstanceChannel::frame(InstanceChannel::FocusCommand));
+                primary->flush();
+                primary->waitForBytesWritten(1000);
+                primary->disconnectFromServer();
                 qApp->quit();
             });
             return false;
         }
 
-        QFile requestFile(requestFilePath);
-        if (requestFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-            requestFile.close();
-        }
+        InstanceRegistry::registerSelf();
 
         VexWidget *editor = new VexWidget(mainWin);
         mainWin->installEventFilter(editor);
@@ -2370,43 +5524,23 @@ public:
         editor->loadSettings();
         editor->setAcceptDrops(true);
 
-        QFileSystemWatcher *watcher = new QFileSystemWatcher(editor);
-        watcher->addPath(requestFilePath);
-        QObject::connect(watcher, &QFileSystemWatcher::fileChanged, editor,
-                         [editor, requestFilePath]() {
-                             QTimer::singleShot(100, [editor, requestFilePath]() {
-                                 editor->handleInstanceRequest(requestFilePath);
-                             });
-                         });
-
-        QTimer::singleShot(0, [editor, &cmdLine]() {
-            QStringList files = cmdLine.flagArgs("f");
-            for (const QString& filePath : std::as_const(files)) {
-                editor->openFileAtPath(filePath);
-            }
+        InstanceChannel *channel = new InstanceChannel(editor);
+        if (!channel->listen()) {
+            qWarning() << "Vex: single-instance channel unavailable:" << InstanceChannel::serverName();
+        }
+        connect(channel, &InstanceChannel::openRequested, editor, &VexWidget::openFiles);
+        connect(channel, &InstanceChannel::gotoRequested, editor, &VexWidget::gotoLine);
+        connect(channel, &InstanceChannel::focusRequested, editor, [mainWin]() {
+            if (mainWin->isMinimized()) mainWin->showNormal();
+            mainWin->raise();
+            mainWin->activateWindow();
         });
 
-        connect(qApp, &QCoreApplication::aboutToQuit, [requestFilePath]() {
-            QFile::remove(requestFilePath);
+        QTimer::singleShot(0, [editor, &cmdLine]() {
+            editor->openFiles(cmdLine.flagArgs("f"), cmdLine.value("l").toInt());
         });
 
         return true;
     }
-
-private:
-    bool isProcessAlive(qint64 pid) {
-#ifdef Q_OS_WIN
-        QProcess p;
-        p.start("tasklist", QStringList() << "/FI" << QString("PID eq %1").arg(pid));
-        p.waitForFinished();
-        QString output = QString::fromLocal8Bit(p.readAllStandardOutput());
-        return output.contains(QString::number(pid));
-#else
-        QProcess p;
-        p.start("ps", QStringList() << "-p" << QString::number(pid));
-        p.waitForFinished();
-        return p.exitCode() == 0;
-#endif
-    }
 };
 #include "VexCore.moc"
@@ -35,12 +35,23 @@ public:
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
+    StartupTrace& trace = StartupTrace::instance();
+    trace.hold();
+
+    {
+        StartupTrace::Scope scope("Settings load", "startup");
+        Settings::instance();
+    }
     MainWindow vex;
 
     CmdLine& cmdLine = CmdLine::instance();
     PluginLoader::loadAndInitialize(&vex, &Settings::instance(), cmdLine, argc, argv);
 
     vex.show();
+    QTimer::singleShot(0, [&trace]() {
+        trace.mark("first event loop");
+        trace.release();
+    });
 
     int result = app.exec();
     PluginLoader::cleanup();